@@ -0,0 +1,669 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2021 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Golden image check of the blur code. Every variant of expblur() (the vectorized kernels,
+ * the column strips, the transposition and the downsample pyramid) is compared against a
+ * frozen copy of the original scalar implementation on a fixed set of generated images,
+ * the other algorithms against the Gaussian they approximate, and the other formats which
+ * are blurred without a conversion against the 32-bit ones.
+ * Each comparison prints the maximum and the mean absolute error and the PSNR, and fails
+ * if they are outside of the tolerance of its variant. The exit code is the number of
+ * failed comparisons.
+ */
+
+#include "../blurengine.h"
+#include <QtGui/qimage.h>
+#include <QtCore/qmath.h>
+#include <QtCore/qvector.h>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+namespace Reference {
+
+/*
+ * expblur() as it was copied from qpixmapfilter.cpp, with aprec = 12 and zprec = 10. Do not
+ * "improve" anything in here, it is what the optimized code is measured against. The only
+ * differences are the plain loops which replace qt_memrotate90() and qt_memrotate270(),
+ * and that 8-bit images are not offset by alphaIndex in alpha-only mode anymore, the
+ * original read the wrong byte (and past the end of the row) there.
+ */
+
+constexpr int aprec = 12;
+constexpr int zprec = 10;
+
+static const int alphaIndex = ((QSysInfo::ByteOrder == QSysInfo::BigEndian) ? 0 : 3);
+
+template<const int shift>
+static inline int qt_static_shift(const int value)
+{
+    if (shift == 0) {
+        return value;
+    } else if (shift > 0) {
+        return value << (uint(shift) & 0x1f);
+    } else {
+        return value >> (uint(-shift) & 0x1f);
+    }
+}
+
+static inline void qt_blurinner(uchar *bptr, int &zR, int &zG, int &zB, int &zA, const int alpha)
+{
+    QRgb *pixel = reinterpret_cast<QRgb *>(bptr);
+#define Z_MASK (0xff << zprec)
+    const int A_zprec = qt_static_shift<zprec - 24>(*pixel) & Z_MASK;
+    const int R_zprec = qt_static_shift<zprec - 16>(*pixel) & Z_MASK;
+    const int G_zprec = qt_static_shift<zprec - 8>(*pixel)  & Z_MASK;
+    const int B_zprec = qt_static_shift<zprec>(*pixel)      & Z_MASK;
+#undef Z_MASK
+    const int zR_zprec = zR >> aprec;
+    const int zG_zprec = zG >> aprec;
+    const int zB_zprec = zB >> aprec;
+    const int zA_zprec = zA >> aprec;
+    zR += alpha * (R_zprec - zR_zprec);
+    zG += alpha * (G_zprec - zG_zprec);
+    zB += alpha * (B_zprec - zB_zprec);
+    zA += alpha * (A_zprec - zA_zprec);
+#define ZA_MASK (0xff << (zprec + aprec))
+    *pixel =
+        qt_static_shift<24 - zprec - aprec>(zA & ZA_MASK)
+        | qt_static_shift<16 - zprec - aprec>(zR & ZA_MASK)
+        | qt_static_shift<8 - zprec - aprec>(zG & ZA_MASK)
+        | qt_static_shift<-zprec - aprec>(zB & ZA_MASK);
+#undef ZA_MASK
+}
+
+static inline void qt_blurinner_alphaOnly(uchar *bptr, int &z, const int alpha)
+{
+    const int A_zprec = int(*(bptr)) << zprec;
+    const int z_zprec = z >> aprec;
+    z += alpha * (A_zprec - z_zprec);
+    *(bptr) = z >> (zprec + aprec);
+}
+
+template<const bool alphaOnly>
+static inline void qt_blurrow(QImage &im, const int line, const int alpha)
+{
+    uchar *bptr = im.scanLine(line);
+    int zR = 0, zG = 0, zB = 0, zA = 0;
+    if (alphaOnly && (im.depth() == 32)) {
+        bptr += alphaIndex;
+    }
+    const int stride = im.depth() >> 3;
+    const int im_width = im.width();
+    for (int index = 0; index < im_width; ++index) {
+        if (alphaOnly) {
+            qt_blurinner_alphaOnly(bptr, zA, alpha);
+        } else {
+            qt_blurinner(bptr, zR, zG, zB, zA, alpha);
+        }
+        bptr += stride;
+    }
+    bptr -= stride;
+    for (int index = im_width - 2; index >= 0; --index) {
+        bptr -= stride;
+        if (alphaOnly) {
+            qt_blurinner_alphaOnly(bptr, zA, alpha);
+        } else {
+            qt_blurinner(bptr, zR, zG, zB, zA, alpha);
+        }
+    }
+}
+
+// qt_memrotate270() moves source column "x" to destination row "x", bottom to top,
+// qt_memrotate90() moves it to destination row "width - x - 1", top to bottom.
+template<typename T>
+static inline void memrotate(const QImage &src, QImage &dest, const bool clockwise)
+{
+    for (int y = 0; y < src.height(); ++y) {
+        const T *s = reinterpret_cast<const T *>(src.constScanLine(y));
+        for (int x = 0; x < src.width(); ++x) {
+            T *d = reinterpret_cast<T *>(dest.scanLine(clockwise ? x : (src.width() - x - 1)));
+            d[clockwise ? (src.height() - y - 1) : y] = s[x];
+        }
+    }
+}
+
+static inline void memrotate(const QImage &src, QImage &dest, const bool clockwise)
+{
+    if (src.depth() == 8) {
+        memrotate<quint8>(src, dest, clockwise);
+    } else {
+        memrotate<quint32>(src, dest, clockwise);
+    }
+}
+
+template<const bool alphaOnly>
+static inline void expblur(QImage &img, const qreal radius, const bool improvedQuality = false, const int transposed = 0)
+{
+    qreal _radius = radius;
+    // halve the radius if we're using two passes
+    if (improvedQuality) {
+        _radius *= 0.5;
+    }
+    // choose the alpha such that pixels at radius distance from a fully
+    // saturated pixel will have an alpha component of no greater than
+    // the cutOffIntensity
+    const qreal cutOffIntensity = 2;
+    const int alpha = _radius <= qreal(1e-5)
+                    ? ((1 << aprec)-1)
+                    : qRound((1<<aprec)*(1 - qPow(cutOffIntensity * (1 / qreal(255)), 1 / _radius)));
+    int img_height = img.height();
+    for (int row = 0; row < img_height; ++row) {
+        for (int i = 0; i <= int(improvedQuality); ++i) {
+            qt_blurrow<alphaOnly>(img, row, alpha);
+        }
+    }
+    QImage temp(img.height(), img.width(), img.format());
+    temp.setDevicePixelRatio(img.devicePixelRatio());
+    memrotate(img, temp, transposed >= 0);
+    img_height = temp.height();
+    for (int row = 0; row < img_height; ++row) {
+        for (int i = 0; i <= int(improvedQuality); ++i) {
+            qt_blurrow<alphaOnly>(temp, row, alpha);
+        }
+    }
+    if (transposed == 0) {
+        memrotate(temp, img, false);
+    } else {
+        img = temp;
+    }
+}
+
+/*
+ * The box, stack and recursive Gaussian blurs don't approximate expblur(), which fades to
+ * transparent black at the edges, but a true Gaussian of the same width with the edges
+ * extended. This is that Gaussian, a plain convolution in double precision.
+ */
+static inline void gaussianLine(uchar *line, const int length, const qsizetype step, const int channels,
+                                const QVector<double> &weights, QVector<double> &values)
+{
+    const int radius = int(weights.size()) - 1;
+    values.resize(length * channels);
+    for (int index = 0; index < length; ++index) {
+        for (int channel = 0; channel < channels; ++channel) {
+            double value = 0;
+            for (int offset = -radius; offset <= radius; ++offset) {
+                const int source = qBound(0, index + offset, length - 1);
+                value += weights.at(qAbs(offset)) * line[source * step + channel];
+            }
+            values[index * channels + channel] = value;
+        }
+    }
+    for (int index = 0; index < length; ++index) {
+        for (int channel = 0; channel < channels; ++channel) {
+            line[index * step + channel] = uchar(qBound(0, int(values.at(index * channels + channel) + 0.5), 255));
+        }
+    }
+}
+
+static inline void gaussian(QImage &img, const qreal sigma)
+{
+    if (sigma < 0.5) {
+        return;
+    }
+    const int radius = qCeil(sigma * 4);
+    QVector<double> weights(radius + 1);
+    double sum = 0;
+    for (int offset = 0; offset <= radius; ++offset) {
+        weights[offset] = std::exp(-(offset * offset) / (2 * sigma * sigma));
+        sum += (offset == 0) ? weights.at(offset) : (2 * weights.at(offset));
+    }
+    for (auto &&weight : weights) {
+        weight /= sum;
+    }
+    const int channels = img.depth() >> 3;
+    QVector<double> values = {};
+    for (int y = 0; y < img.height(); ++y) {
+        gaussianLine(img.scanLine(y), img.width(), channels, channels, weights, values);
+    }
+    for (int x = 0; x < img.width(); ++x) {
+        gaussianLine(img.bits() + x * channels, img.height(), img.bytesPerLine(), channels, weights, values);
+    }
+}
+
+}
+
+struct Tolerance
+{
+    int maxError = 0;
+    qreal meanError = 0;
+    qreal minPsnr = std::numeric_limits<qreal>::infinity();
+};
+
+struct Statistics
+{
+    int maxError = 0;
+    qreal meanError = 0;
+    qreal psnr = std::numeric_limits<qreal>::infinity();
+};
+
+// Only the channels which are blurred are looked at. Pixels closer than "margin" to an edge
+// are left out, but a result that doesn't cover all of them fails, whatever its pixels are:
+// the pyramid has to go back up to the full size of an odd sized image.
+static inline Statistics compare(const QImage &expected, const QImage &actual, const bool alphaOnly, const int margin = 0)
+{
+    Statistics statistics = {};
+    // Alpha-only results may come back as a packed 8-bit plane.
+    if ((!alphaOnly && (expected.depth() != actual.depth())) || (expected.size() != actual.size())
+            || expected.isNull() || actual.isNull()) {
+        statistics.maxError = 255;
+        statistics.meanError = 255;
+        statistics.psnr = 0;
+        return statistics;
+    }
+    const int width = expected.width();
+    const int height = expected.height();
+    const int expectedPixelSize = expected.depth() >> 3;
+    const int actualPixelSize = actual.depth() >> 3;
+    // Every channel, or just the alpha channel (the only one 8-bit images have).
+    const int channels = alphaOnly ? 1 : expectedPixelSize;
+    const int expectedOffset = (alphaOnly && (expectedPixelSize == 4)) ? Reference::alphaIndex : 0;
+    const int actualOffset = (alphaOnly && (actualPixelSize == 4)) ? Reference::alphaIndex : 0;
+    qint64 sum = 0;
+    qint64 squares = 0;
+    qint64 count = 0;
+    for (int y = margin; y < (height - margin); ++y) {
+        const uchar *e = expected.constScanLine(y) + expectedOffset;
+        const uchar *a = actual.constScanLine(y) + actualOffset;
+        for (int x = margin; x < (width - margin); ++x) {
+            for (int channel = 0; channel < channels; ++channel) {
+                const int error = qAbs(int(e[x * expectedPixelSize + channel]) - int(a[x * actualPixelSize + channel]));
+                statistics.maxError = qMax(statistics.maxError, error);
+                sum += error;
+                squares += error * error;
+                ++count;
+            }
+        }
+    }
+    if (count > 0) {
+        statistics.meanError = qreal(sum) / count;
+        if (squares > 0) {
+            statistics.psnr = 10 * std::log10(qreal(255 * 255) / (qreal(squares) / count));
+        }
+    }
+    return statistics;
+}
+
+struct CorpusImage
+{
+    const char *name = nullptr;
+    QImage image = {};
+};
+
+// Deterministic on every platform and Qt version, unlike QRandomGenerator's global instance.
+static inline quint32 nextRandom(quint32 &state)
+{
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+static inline QImage generate(const int kind, const QSize &size, const QImage::Format format)
+{
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    quint32 state = 12345;
+    for (int y = 0; y < size.height(); ++y) {
+        auto line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < size.width(); ++x) {
+            int r = 0, g = 0, b = 0, a = 255;
+            switch (kind) {
+            case 0: // Smooth gradients, the typical wallpaper.
+                a = 64 + (191 * x / qMax(size.width() - 1, 1));
+                r = (255 * x / qMax(size.width() - 1, 1)) * a / 255;
+                g = (255 * y / qMax(size.height() - 1, 1)) * a / 255;
+                b = 128 * a / 255;
+                break;
+            case 1: // Noise, the worst case for every approximation.
+                a = int(nextRandom(state) & 0xff);
+                r = int(nextRandom(state) % (a + 1));
+                g = int(nextRandom(state) % (a + 1));
+                b = int(nextRandom(state) % (a + 1));
+                break;
+            case 2: // Hard edges.
+                r = g = b = ((((x / 8) + (y / 8)) % 2) == 0) ? 255 : 0;
+                break;
+            default: { // An opaque shape on a transparent background, like a shadow mask.
+                const int dx = x - (size.width() / 2);
+                const int dy = y - (size.height() / 2);
+                const int limit = qMin(size.width(), size.height()) / 3;
+                a = (((dx * dx) + (dy * dy)) <= (limit * limit)) ? 255 : 0;
+                r = g = b = a / 2;
+            } break;
+            }
+            line[x] = qRgba(r, g, b, a);
+        }
+    }
+    if (format == QImage::Format_RGB32) {
+        // Opaque versions of the same content.
+        for (int y = 0; y < size.height(); ++y) {
+            auto line = reinterpret_cast<QRgb *>(image.scanLine(y));
+            for (int x = 0; x < size.width(); ++x) {
+                line[x] |= 0xff000000;
+            }
+        }
+        image.reinterpretAsFormat(QImage::Format_RGB32);
+        return image;
+    }
+    if ((format == QImage::Format_Grayscale8) || (format == QImage::Format_Alpha8)) {
+        // The green or the alpha channel on its own.
+        const bool alpha = (format == QImage::Format_Alpha8);
+        QImage plane(size, format);
+        for (int y = 0; y < size.height(); ++y) {
+            auto src = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+            uchar *dest = plane.scanLine(y);
+            for (int x = 0; x < size.width(); ++x) {
+                dest[x] = uchar(alpha ? qAlpha(src[x]) : qGreen(src[x]));
+            }
+        }
+        return plane;
+    }
+    return image;
+}
+
+static const char *const g_kindNames[] = {"gradient", "noise", "edges", "mask"};
+
+static const QSize g_sizes[] = {{320, 200}, {97, 61}, {1, 50}, {50, 1}};
+
+struct FormatName
+{
+    const char *name = nullptr;
+    QImage::Format format = QImage::Format_Invalid;
+};
+
+static const FormatName g_formats[] = {
+    {"ARGB32_Premultiplied", QImage::Format_ARGB32_Premultiplied},
+    {"RGB32", QImage::Format_RGB32},
+    {"Grayscale8", QImage::Format_Grayscale8},
+    {"Alpha8", QImage::Format_Alpha8}
+};
+
+// The same pixels in a format that is blurred natively as well. The blur treats every byte
+// on its own, so the 32-bit bytes are kept as they are, RGB888 drops the alpha byte.
+static inline QImage repack(const QImage &image, const QImage::Format format)
+{
+    if (format != QImage::Format_RGB888) {
+        QImage copy = image.copy();
+        copy.reinterpretAsFormat(format);
+        return copy;
+    }
+    QImage packed(image.size(), QImage::Format_RGB888);
+    for (int y = 0; y < image.height(); ++y) {
+        const uchar *src = image.constScanLine(y);
+        uchar *dest = packed.scanLine(y);
+        for (int x = 0; x < image.width(); ++x) {
+            for (int byte = 0, channel = 0; byte < 4; ++byte) {
+                if (byte != Reference::alphaIndex) {
+                    dest[x * 3 + channel++] = src[x * 4 + byte];
+                }
+            }
+        }
+    }
+    return packed;
+}
+
+// What BlurEngine::setContentTolerance() is there for: a solid color, or an opaque plane,
+// which the premultiplied gradient of generate() isn't.
+static inline QImage generateSmooth(const bool solid, const QSize &size)
+{
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    for (int y = 0; y < size.height(); ++y) {
+        auto line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < size.width(); ++x) {
+            line[x] = solid ? qRgb(40, 120, 200) : qRgb(255 * x / (size.width() - 1), 255 * y / (size.height() - 1), 128);
+        }
+    }
+    return image;
+}
+
+static const FormatName g_nativeFormats[] = {
+    {"RGBA8888_Premultiplied", QImage::Format_RGBA8888_Premultiplied},
+    {"RGBX8888", QImage::Format_RGBX8888},
+    {"RGB888", QImage::Format_RGB888}
+};
+
+// What BlurEngine::setContentTolerance() promises, three times the radius away from the edges.
+static const Tolerance g_contentTolerance = {2, 2.0, 0};
+
+static int g_failures = 0;
+static int g_comparisons = 0;
+
+static inline void report(const char *variant, const char *kind, const QSize &size, const char *format,
+                          const qreal radius, const bool quality, const Statistics &statistics, const Tolerance &tolerance)
+{
+    const bool passed = (statistics.maxError <= tolerance.maxError)
+                        && (statistics.meanError <= tolerance.meanError)
+                        && (statistics.psnr >= tolerance.minPsnr);
+    ++g_comparisons;
+    if (!passed) {
+        ++g_failures;
+    }
+    std::printf("%s %-12s %-9s %4dx%-4d %-21s r=%-6.1f %-7s max=%-4d mean=%-8.4f psnr=%.2f\n",
+                passed ? "PASS" : "FAIL", variant, kind, size.width(), size.height(), format,
+                radius, quality ? "quality" : "fast", statistics.maxError, statistics.meanError, statistics.psnr);
+}
+
+int main()
+{
+    // The vectorized kernels, the column strips and the transposition have to be exact.
+    const Tolerance exact = {};
+    // Downsampling, blurring a quarter of the pixels (or less) and upsampling again.
+    // The edges, which expblur() darkens, differ the most, so only the average error counts.
+    // The last row and column of an odd size never make it into the blur, the hard edges
+    // of a 97x61 image lose a whole stripe of their pattern there.
+    const Tolerance pyramid = {255, 10.0, 24};
+    // Approximations of a Gaussian, compared against the real one. Small radii are the
+    // hardest for them, a single three pixel box is only so close to a Gaussian.
+    const Tolerance algorithm = {255, 10.0, 24};
+
+    const qreal radii[] = {0, 1, 3, 8, 20, 64, 128};
+    BlurEngine engine;
+    for (auto &&format : g_formats) {
+        for (int kind = 0; kind != 4; ++kind) {
+            for (auto &&size : g_sizes) {
+                const QImage source = generate(kind, size, format.format);
+                // 8-bit images are a single channel, for the blur and for the pyramid.
+                const bool singleChannel = (source.depth() == 8);
+                for (auto &&radius : radii) {
+                    for (const bool quality : {false, true}) {
+                        engine.setImprovedQuality(quality);
+                        engine.setAlgorithm(Utilities::BlurAlgorithm::Exponential);
+
+                        QImage expected = source;
+                        if (singleChannel) {
+                            Reference::expblur<true>(expected, radius, quality);
+                        } else {
+                            Reference::expblur<false>(expected, radius, quality);
+                        }
+
+                        QImage actual = source;
+                        engine.blur(actual, radius);
+                        report("expblur", g_kindNames[kind], size, format.name, radius, quality,
+                               compare(expected, actual, false), exact);
+
+                        for (const int transposed : {-1, 1}) {
+                            QImage expectedTransposed = source;
+                            QImage actualTransposed = source;
+                            if (singleChannel) {
+                                Reference::expblur<true>(expectedTransposed, radius, quality, transposed);
+                            } else {
+                                Reference::expblur<false>(expectedTransposed, radius, quality, transposed);
+                            }
+                            engine.blur(actualTransposed, radius, transposed);
+                            report((transposed > 0) ? "transposed+" : "transposed-", g_kindNames[kind], size, format.name,
+                                   radius, quality, compare(expectedTransposed, actualTransposed, false), exact);
+                        }
+
+                        engine.blur(nullptr, source, radius, false);
+                        const QImage blurred = engine.takeResult();
+                        report("pyramid", g_kindNames[kind], size, format.name, radius, quality,
+                               compare(expected, blurred, false), (radius < 4) ? exact : pyramid);
+
+                        // Solid colors and gradients may skip the blur, but only if the result stays
+                        // within the tolerance of the full blur, away from the edges.
+                        engine.setContentTolerance(g_contentTolerance.maxError);
+                        engine.blur(nullptr, source, radius, false);
+                        engine.setContentTolerance(0);
+                        report("content", g_kindNames[kind], size, format.name, radius, quality,
+                               compare(blurred, engine.getResult(), false, qCeil(radius * 3)), g_contentTolerance);
+
+                        // Grayscale8 has no alpha channel, it's opaque.
+                        QImage expectedAlpha = source;
+                        if (format.format == QImage::Format_Grayscale8) {
+                            expectedAlpha.fill(0xff);
+                        }
+                        Reference::expblur<true>(expectedAlpha, radius, quality);
+                        engine.blur(nullptr, source, radius, true);
+                        report("alphaOnly", g_kindNames[kind], size, format.name, radius, quality,
+                               compare(expectedAlpha, engine.getResult(), true), (radius < 4) ? exact : pyramid);
+
+                        // With a support wider than the image they only differ in how they
+                        // extend the edges, which isn't what this is about. How close they get
+                        // to a Gaussian is measured on the 32-bit images, 8-bit ones go through
+                        // the same per-byte code and lack the opaque alpha channel which the
+                        // tolerance was made with.
+                        if (singleChannel || (radius > (qMax(size.width(), size.height()) / 4))) {
+                            continue;
+                        }
+                        const struct
+                        {
+                            const char *name;
+                            Utilities::BlurAlgorithm algorithm;
+                        } algorithms[] = {
+                            {"box", Utilities::BlurAlgorithm::Box},
+                            {"stack", Utilities::BlurAlgorithm::Stack},
+                            {"gaussian", Utilities::BlurAlgorithm::Gaussian}
+                        };
+                        QImage expectedGaussian = source;
+                        Reference::gaussian(expectedGaussian, radius / 3);
+                        for (auto &&other : algorithms) {
+                            engine.setAlgorithm(other.algorithm);
+                            QImage blurred = source;
+                            engine.blur(blurred, radius);
+                            report(other.name, g_kindNames[kind], size, format.name, radius, quality,
+                                   compare(expectedGaussian, blurred, false), algorithm);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    // The same promise on images the shortcut is actually taken for.
+    const QSize smoothSize = {640, 400};
+    for (const bool solid : {true, false}) {
+        const QImage source = generateSmooth(solid, smoothSize);
+        // Small enough to leave some of the image away from the edges.
+        for (const qreal radius : {8.0, 20.0, 40.0, 64.0}) {
+            for (const bool quality : {false, true}) {
+                engine.setImprovedQuality(quality);
+                engine.setAlgorithm(Utilities::BlurAlgorithm::Exponential);
+                engine.blur(nullptr, source, radius, false);
+                const QImage blurred = engine.takeResult();
+                engine.setContentTolerance(g_contentTolerance.maxError);
+                engine.blur(nullptr, source, radius, false);
+                engine.setContentTolerance(0);
+                report("content", solid ? "solid" : "plane", smoothSize, "ARGB32_Premultiplied", radius, quality,
+                       compare(blurred, engine.getResult(), false, qCeil(radius * 3)), g_contentTolerance);
+            }
+        }
+    }
+
+    // Every level of the pyramid drops the last row and column of an odd size, the way back
+    // up has to cover them again. Both sizes are odd at the first levels, the strips along
+    // the right and the bottom edge are as wide as a pixel of the deepest level.
+    const QSize oddSize = {1366, 99};
+    const QImage oddSource = generateSmooth(false, oddSize);
+    for (const qreal radius : {8.0, 64.0, 128.0}) {
+        for (const bool quality : {false, true}) {
+            engine.setImprovedQuality(quality);
+            engine.setAlgorithm(Utilities::BlurAlgorithm::Exponential);
+            QImage expected = oddSource;
+            Reference::expblur<false>(expected, radius, quality);
+            engine.blur(nullptr, oddSource, radius, false);
+            const QImage blurred = engine.getResult();
+            constexpr int strip = 32;
+            const QRect right = {oddSize.width() - strip, 0, strip, oddSize.height()};
+            const QRect bottom = {0, oddSize.height() - strip, oddSize.width(), strip};
+            report("edgeRight", "plane", oddSize, "ARGB32_Premultiplied", radius, quality,
+                   compare(expected.copy(right), blurred.copy(right), false), pyramid);
+            report("edgeBottom", "plane", oddSize, "ARGB32_Premultiplied", radius, quality,
+                   compare(expected.copy(bottom), blurred.copy(bottom), false), pyramid);
+        }
+    }
+
+    // The other formats which are blurred without a conversion have to come out exactly like
+    // the 32-bit one they were repacked from.
+    const Utilities::BlurAlgorithm algorithms[] = {
+        Utilities::BlurAlgorithm::Exponential, Utilities::BlurAlgorithm::Box,
+        Utilities::BlurAlgorithm::Stack, Utilities::BlurAlgorithm::Gaussian
+    };
+    const qsizetype conversions = qsizetype(Utilities::getBlurFormatConversionCount());
+    for (auto &&format : g_nativeFormats) {
+        for (int kind = 0; kind != 4; ++kind) {
+            for (auto &&size : g_sizes) {
+                const QImage source = generate(kind, size, QImage::Format_ARGB32_Premultiplied);
+                const QImage native = repack(source, format.format);
+                for (auto &&radius : radii) {
+                    for (const bool quality : {false, true}) {
+                        engine.setImprovedQuality(quality);
+                        for (auto &&other : algorithms) {
+                            engine.setAlgorithm(other);
+                            for (const int transposed : {0, 1}) {
+                                QImage expected = source;
+                                engine.blur(expected, radius, transposed);
+                                QImage actual = native;
+                                engine.blur(actual, radius, transposed);
+                                report("native", g_kindNames[kind], size, format.name, radius, quality,
+                                       compare(repack(expected, format.format), actual, false), exact);
+                            }
+                        }
+                        engine.setAlgorithm(Utilities::BlurAlgorithm::Exponential);
+                        engine.blur(nullptr, source, radius, false);
+                        const QImage expected = repack(engine.getResult(), format.format);
+                        engine.blur(nullptr, native, radius, false);
+                        report("nativePyramid", g_kindNames[kind], size, format.name, radius, quality,
+                               compare(expected, engine.getResult(), false), exact);
+                        // The alpha byte of ARGB32 moves with the byte order, the one of RGBA8888 doesn't.
+                        if ((format.format == QImage::Format_RGBA8888_Premultiplied) && (Reference::alphaIndex == 3)) {
+                            engine.blur(nullptr, source, radius, true);
+                            const QImage expectedAlpha = engine.getResult();
+                            engine.blur(nullptr, native, radius, true);
+                            report("nativeAlpha", g_kindNames[kind], size, format.name, radius, quality,
+                                   compare(expectedAlpha, engine.getResult(), true), exact);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    // Not a single one of them needed a conversion.
+    ++g_comparisons;
+    if (qsizetype(Utilities::getBlurFormatConversionCount()) != conversions) {
+        ++g_failures;
+        std::printf("FAIL native formats were converted %lld times\n",
+                    static_cast<long long>(qsizetype(Utilities::getBlurFormatConversionCount()) - conversions));
+    }
+
+    std::printf("%d of %d comparisons failed\n", g_failures, g_comparisons);
+    return g_failures;
+}
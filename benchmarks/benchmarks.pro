@@ -0,0 +1,20 @@
+TARGET = framelesshelper_bench
+TEMPLATE = app
+QT += gui testlib
+CONFIG += c++17 strict_c++ utf8_source warn_on console
+CONFIG -= app_bundle
+DEFINES += \
+    QT_NO_CAST_FROM_ASCII \
+    QT_NO_CAST_TO_ASCII \
+    QT_NO_KEYWORDS \
+    QT_DEPRECATED_WARNINGS \
+    QT_DISABLE_DEPRECATED_BEFORE=0x060000
+HEADERS += blurbenchmark.h
+SOURCES += blurbenchmark.cpp main.cpp
+DESTDIR = $$OUT_PWD/../bin
+win32 {
+    CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../debug -lFramelessHelperd
+    else: CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../release -lFramelessHelper
+} else: unix {
+    LIBS += -L$$OUT_PWD/../bin -lFramelessHelper
+}
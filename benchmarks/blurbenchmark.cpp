@@ -0,0 +1,251 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2021 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "blurbenchmark.h"
+#include "../blurengine.h"
+#include <QtTest/qtest.h>
+#include <QtCore/qthread.h>
+#include <QtCore/qdebug.h>
+#include <QtCore/qrandom.h>
+
+Q_DECLARE_METATYPE(QImage::Format)
+Q_DECLARE_METATYPE(Utilities::BlurAlgorithm)
+
+struct Resolution
+{
+    const char *name = nullptr;
+    QSize size = {};
+};
+
+static const Resolution g_resolutions[] = {
+    {"720p", {1280, 720}},
+    {"1080p", {1920, 1080}},
+    {"4K", {3840, 2160}},
+    {"8K", {7680, 4320}},
+    {"ultrawide", {3440, 1440}}
+};
+
+static const int g_radii[] = {4, 16, 64, 128, 256};
+
+struct Format
+{
+    const char *name = nullptr;
+    QImage::Format format = QImage::Format_Invalid;
+};
+
+static const Format g_formats[] = {
+    {"RGB32", QImage::Format_RGB32},
+    {"ARGB32_Premultiplied", QImage::Format_ARGB32_Premultiplied},
+    {"RGBA8888_Premultiplied", QImage::Format_RGBA8888_Premultiplied},
+    {"RGB888", QImage::Format_RGB888},
+    {"Grayscale8", QImage::Format_Grayscale8}
+};
+
+// A gradient with some noise on top. The blur doesn't care about the content, but the
+// images should at least look like something a wallpaper could be.
+static inline QImage syntheticImage(const QSize &size, const QImage::Format format)
+{
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    QRandomGenerator random(42);
+    for (int y = 0; y < image.height(); ++y) {
+        auto line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            const int noise = int(random.bounded(32));
+            const int alpha = 128 + (x * 127 / image.width());
+            const int red = qMin((x * 255 / image.width()) + noise, alpha);
+            const int green = qMin((y * 255 / image.height()) + noise, alpha);
+            const int blue = qMin(((x + y) * 255 / (image.width() + image.height())) + noise, alpha);
+            line[x] = qRgba(red, green, blue, alpha);
+        }
+    }
+    return (format == image.format()) ? image : image.convertToFormat(format);
+}
+
+static inline void addColumns()
+{
+    QTest::addColumn<QImage::Format>("format");
+    QTest::addColumn<QSize>("size");
+    QTest::addColumn<int>("radius");
+}
+
+BlurBenchmark::BlurBenchmark(QObject *parent) : QObject(parent) {}
+
+BlurBenchmark::~BlurBenchmark() = default;
+
+void BlurBenchmark::initTestCase()
+{
+    qInfo() << "Threads:" << QThread::idealThreadCount()
+            << "Multi-threading threshold:" << Utilities::getBlurMultiThreadingThreshold()
+            << "Scalar kernels forced:" << Utilities::forceScalarBlur();
+}
+
+void BlurBenchmark::expblur_data()
+{
+    addColumns();
+    QTest::addColumn<bool>("quality");
+    for (auto &&format : g_formats) {
+        for (auto &&resolution : g_resolutions) {
+            for (auto &&radius : g_radii) {
+                for (const bool quality : {false, true}) {
+                    QTest::addRow("%s/%s/r%d/%s", format.name, resolution.name, radius, quality ? "quality" : "fast")
+                        << format.format << resolution.size << radius << quality;
+                }
+            }
+        }
+    }
+}
+
+void BlurBenchmark::expblur()
+{
+    QFETCH(QImage::Format, format);
+    QFETCH(QSize, size);
+    QFETCH(int, radius);
+    QFETCH(bool, quality);
+    BlurEngine engine;
+    engine.setImprovedQuality(quality);
+    QImage image = syntheticImage(size, format);
+    // The first call sizes the buffers of the engine.
+    engine.blur(image, radius);
+    QBENCHMARK {
+        engine.blur(image, radius);
+    }
+}
+
+void BlurBenchmark::algorithms_data()
+{
+    QTest::addColumn<Utilities::BlurAlgorithm>("algorithm");
+    QTest::addColumn<QSize>("size");
+    QTest::addColumn<int>("radius");
+    const struct
+    {
+        const char *name;
+        Utilities::BlurAlgorithm algorithm;
+    } algorithms[] = {
+        {"Exponential", Utilities::BlurAlgorithm::Exponential},
+        {"Box", Utilities::BlurAlgorithm::Box},
+        {"Stack", Utilities::BlurAlgorithm::Stack},
+        {"Gaussian", Utilities::BlurAlgorithm::Gaussian}
+    };
+    for (auto &&algorithm : algorithms) {
+        for (auto &&resolution : g_resolutions) {
+            for (auto &&radius : g_radii) {
+                QTest::addRow("%s/%s/r%d", algorithm.name, resolution.name, radius)
+                    << algorithm.algorithm << resolution.size << radius;
+            }
+        }
+    }
+}
+
+void BlurBenchmark::algorithms()
+{
+    QFETCH(Utilities::BlurAlgorithm, algorithm);
+    QFETCH(QSize, size);
+    QFETCH(int, radius);
+    BlurEngine engine;
+    engine.setAlgorithm(algorithm);
+    QImage image = syntheticImage(size, QImage::Format_ARGB32_Premultiplied);
+    engine.blur(image, radius);
+    QBENCHMARK {
+        engine.blur(image, radius);
+    }
+}
+
+void BlurBenchmark::pyramid_data()
+{
+    addColumns();
+    QTest::addColumn<bool>("quality");
+    QTest::addColumn<bool>("alphaOnly");
+    for (auto &&format : g_formats) {
+        for (auto &&resolution : g_resolutions) {
+            for (auto &&radius : g_radii) {
+                for (const bool quality : {false, true}) {
+                    for (const bool alphaOnly : {false, true}) {
+                        QTest::addRow("%s/%s/r%d/%s%s", format.name, resolution.name, radius,
+                                      quality ? "quality" : "fast", alphaOnly ? "/alphaOnly" : "")
+                            << format.format << resolution.size << radius << quality << alphaOnly;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void BlurBenchmark::pyramid()
+{
+    QFETCH(QImage::Format, format);
+    QFETCH(QSize, size);
+    QFETCH(int, radius);
+    QFETCH(bool, quality);
+    QFETCH(bool, alphaOnly);
+    BlurEngine engine;
+    engine.setImprovedQuality(quality);
+    const QImage image = syntheticImage(size, format);
+    engine.blur(nullptr, image, radius, alphaOnly);
+    QBENCHMARK {
+        engine.blur(nullptr, image, radius, alphaOnly);
+    }
+}
+
+void BlurBenchmark::halfScaled_data()
+{
+    QTest::addColumn<QImage::Format>("format");
+    QTest::addColumn<QSize>("size");
+    for (auto &&format : g_formats) {
+        for (auto &&resolution : g_resolutions) {
+            QTest::addRow("%s/%s", format.name, resolution.name) << format.format << resolution.size;
+        }
+    }
+}
+
+void BlurBenchmark::halfScaled()
+{
+    QFETCH(QImage::Format, format);
+    QFETCH(QSize, size);
+    BlurEngine engine;
+    const QImage image = syntheticImage(size, format);
+    QImage result = {};
+    engine.downsample(image, result);
+    QBENCHMARK {
+        engine.downsample(image, result);
+    }
+}
+
+void BlurBenchmark::doubleScaled_data()
+{
+    halfScaled_data();
+}
+
+void BlurBenchmark::doubleScaled()
+{
+    QFETCH(QImage::Format, format);
+    QFETCH(QSize, size);
+    BlurEngine engine;
+    // Scaled back up to the size of the row.
+    const QImage image = syntheticImage(size / 2, format);
+    QImage result = {};
+    engine.upsample(image, result);
+    QBENCHMARK {
+        engine.upsample(image, result);
+    }
+}
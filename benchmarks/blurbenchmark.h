@@ -0,0 +1,64 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2021 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "../framelesshelper_global.h"
+#include <QtCore/qobject.h>
+
+/*
+ * Benchmarks of the blur code. Run them with "-o <file>,xml" (or csv, or junitxml) to get
+ * results which can be compared between builds, and set "_FRAMELESSHELPER_FORCE_SCALAR_BLUR"
+ * to measure the scalar kernels instead of the vectorized ones.
+ */
+class BlurBenchmark : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY_MOVE(BlurBenchmark)
+
+public:
+    explicit BlurBenchmark(QObject *parent = nullptr);
+    ~BlurBenchmark() override;
+
+private Q_SLOTS:
+    void initTestCase();
+
+    // expblur() at full resolution, the way Utilities::blurImage(QImage &, ...) runs it.
+    void expblur_data();
+    void expblur();
+
+    // The other algorithms, their cost should not depend on the radius.
+    void algorithms_data();
+    void algorithms();
+
+    // The whole downsample pyramid, the way the wallpaper is blurred.
+    void pyramid_data();
+    void pyramid();
+
+    // qt_halfScaled() and its way back up.
+    void halfScaled_data();
+    void halfScaled();
+    void doubleScaled_data();
+    void doubleScaled();
+};
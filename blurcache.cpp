@@ -0,0 +1,151 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2021 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "blurcache.h"
+#include <QtCore/qcache.h>
+#include <QtCore/qmutex.h>
+#include <limits>
+
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
+using BlurCacheHash = size_t;
+#else
+using BlurCacheHash = uint;
+#endif
+
+namespace BlurCache {
+
+// Found by QCache through argument dependent lookup.
+static inline bool operator==(const Key &lhs, const Key &rhs)
+{
+    return (lhs.cacheKey == rhs.cacheKey) && (lhs.radius == rhs.radius) && (lhs.transposed == rhs.transposed)
+            && (lhs.algorithm == rhs.algorithm) && (lhs.quality == rhs.quality) && (lhs.alphaOnly == rhs.alphaOnly);
+}
+
+static inline BlurCacheHash qHash(const Key &key, const BlurCacheHash seed = 0)
+{
+    const int flags = (int(key.algorithm) << 2) | (int(key.quality) << 1) | int(key.alphaOnly);
+    return ::qHash(key.cacheKey, seed) ^ ::qHash(key.radius, seed) ^ ::qHash((key.transposed << 8) | flags, seed);
+}
+
+}
+
+namespace {
+
+// QCache counts its cost in an int on Qt 5, so the images are weighed in KiB.
+constexpr qint64 g_costUnit = 1024;
+
+struct BlurCacheData
+{
+    QMutex mutex;
+    QCache<BlurCache::Key, QImage> cache;
+    qint64 budget = 64 * 1024 * 1024;
+    quint64 hits = 0;
+    quint64 misses = 0;
+
+    explicit BlurCacheData()
+    {
+        cache.setMaxCost(int(budget / g_costUnit));
+    }
+};
+
+}
+
+Q_GLOBAL_STATIC(BlurCacheData, blurCacheData)
+
+bool BlurCache::find(const Key &key, QImage &result)
+{
+    BlurCacheData *data = blurCacheData();
+    QMutexLocker locker(&data->mutex);
+    if (data->budget <= 0) {
+        return false;
+    }
+    // QCache::object() moves the entry to the front, the least recently used one goes first.
+    const QImage *image = data->cache.object(key);
+    if (!image) {
+        ++data->misses;
+        return false;
+    }
+    ++data->hits;
+    result = *image;
+    return true;
+}
+
+void BlurCache::insert(const Key &key, const QImage &result)
+{
+    if (result.isNull()) {
+        return;
+    }
+    BlurCacheData *data = blurCacheData();
+    QMutexLocker locker(&data->mutex);
+    if (data->budget <= 0) {
+        return;
+    }
+    // Results larger than the whole budget are rejected (and deleted) by QCache itself.
+    const int cost = int(qMax(result.sizeInBytes() / g_costUnit, qint64(1)));
+    data->cache.insert(key, new QImage(result), cost);
+}
+
+qint64 Utilities::getBlurCacheBudget()
+{
+    BlurCacheData *data = blurCacheData();
+    QMutexLocker locker(&data->mutex);
+    return data->budget;
+}
+
+void Utilities::setBlurCacheBudget(const qint64 bytes)
+{
+    BlurCacheData *data = blurCacheData();
+    QMutexLocker locker(&data->mutex);
+    data->budget = qMax(bytes, qint64(0));
+    // Evicts the least recently used results until the rest fits.
+    data->cache.setMaxCost(int(qMin(data->budget / g_costUnit, qint64(std::numeric_limits<int>::max()))));
+}
+
+void Utilities::clearBlurCache()
+{
+    BlurCacheData *data = blurCacheData();
+    QMutexLocker locker(&data->mutex);
+    data->cache.clear();
+}
+
+Utilities::BlurCacheStatistics Utilities::getBlurCacheStatistics()
+{
+    BlurCacheData *data = blurCacheData();
+    QMutexLocker locker(&data->mutex);
+    BlurCacheStatistics statistics = {};
+    statistics.hits = data->hits;
+    statistics.misses = data->misses;
+    statistics.count = int(data->cache.count());
+    statistics.bytes = qint64(data->cache.totalCost()) * g_costUnit;
+    statistics.budget = data->budget;
+    return statistics;
+}
+
+void Utilities::resetBlurCacheStatistics()
+{
+    BlurCacheData *data = blurCacheData();
+    QMutexLocker locker(&data->mutex);
+    data->hits = 0;
+    data->misses = 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2021 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "framelesshelper_global.h"
+#include "utilities.h"
+
+/*
+ * The process wide cache in front of the QPainter overload of Utilities::blurImage().
+ * The in place overload skips it: a cached copy would share the buffer of its result, and
+ * blurring that image in place again would have to copy it first. Results are found by the
+ * QImage::cacheKey() of their source, which changes whenever the source is modified,
+ * and all the parameters of the blur. See Utilities::setBlurCacheBudget().
+ */
+
+namespace BlurCache {
+
+struct Key
+{
+    qint64 cacheKey = 0;
+    qreal radius = 0.0;
+    int transposed = 0;
+    Utilities::BlurAlgorithm algorithm = Utilities::BlurAlgorithm::Exponential;
+    bool quality = false;
+    bool alphaOnly = false;
+};
+
+// Both do nothing if the cache is disabled.
+bool find(const Key &key, QImage &result);
+void insert(const Key &key, const QImage &result);
+
+}
@@ -0,0 +1,902 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2021 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "blurengine.h"
+#include "blurkernels.h"
+#include <QtGui/qpainter.h>
+#include <QtCore/qmath.h>
+#include <QtCore/qthread.h>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+
+/*
+ * Copied from https://code.qt.io/cgit/qt/qtbase.git/tree/src/widgets/effects/qpixmapfilter.cpp
+ * With minor modifications, most of them are format changes.
+ * They are exported functions of Qt, we can make use of them directly, but they are in the QtWidgets
+ * module, I don't want our library have such a dependency.
+ */
+
+static const int alphaIndex = ((QSysInfo::ByteOrder == QSysInfo::BigEndian) ? 0 : 3);
+
+// See Utilities::getBlurFormatConversionCount().
+static std::atomic<quint64> g_blurFormatConversionCount = 0;
+
+// The kernels treat a pixel as independent 8-bit channels, their order doesn't matter as
+// long as the colors are premultiplied. These formats are blurred as they are.
+static inline bool qt_isNativeBlurFormat(const QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGB32:
+    case QImage::Format_RGBA8888_Premultiplied:
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGB888:
+    case QImage::Format_Grayscale8:
+    case QImage::Format_Alpha8:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Everything else is premultiplied first, RGBA8888 keeps its byte order.
+static inline QImage qt_convertForBlur(const QImage &image)
+{
+    g_blurFormatConversionCount.fetch_add(1, std::memory_order_relaxed);
+    return image.convertToFormat((image.format() == QImage::Format_RGBA8888)
+                                 ? QImage::Format_RGBA8888_Premultiplied : QImage::Format_ARGB32_Premultiplied);
+}
+
+// The format blur(QImage &) leaves "image" in, 8-bit images are blurred as they are.
+static inline QImage::Format qt_blurredFormat(const QImage &image)
+{
+    if ((image.depth() == 8) || qt_isNativeBlurFormat(image.format())) {
+        return image.format();
+    }
+    return (image.format() == QImage::Format_RGBA8888) ? QImage::Format_RGBA8888_Premultiplied : QImage::Format_ARGB32_Premultiplied;
+}
+
+// The RGBA8888 formats are defined byte by byte, ARGB32 is a 32-bit value in the native
+// byte order.
+static inline int qt_alphaOffset(const QImage::Format format)
+{
+    const bool byteOrdered = (format == QImage::Format_RGBA8888) || (format == QImage::Format_RGBA8888_Premultiplied)
+                             || (format == QImage::Format_RGBX8888);
+    return byteOrdered ? 3 : alphaIndex;
+}
+
+// Smallest radius the downsample pyramid leaves for the blur itself.
+static constexpr qreal g_blurPyramidMinimumRadius = 16;
+
+// A few bands per thread keep the threads busy even if some of them start late.
+static inline int qt_blurBandSize(const int length, const int threadCount, const int batchSize)
+{
+    const int bandCount = threadCount * 4;
+    const int bandSize = (length + bandCount - 1) / bandCount;
+    return qMax(batchSize, (bandSize + batchSize - 1) / batchSize * batchSize);
+}
+
+// Buffers are only reallocated if the size or the format changes.
+static inline void qt_reuseImage(QImage &buffer, const QSize &size, const QImage::Format format, const qreal devicePixelRatio)
+{
+    if ((buffer.size() != size) || (buffer.format() != format)) {
+        buffer = QImage(size, format);
+    }
+    buffer.setDevicePixelRatio(devicePixelRatio);
+}
+
+template<typename T>
+static inline T *qt_reuseScratch(QVector<T> &buffer, const qsizetype size)
+{
+    if (buffer.size() < size) {
+        buffer.resize(size);
+    }
+    return buffer.data();
+}
+
+/*
+ * The per-pixel work of qt_blurrow() lives in blurkernels.cpp, which picks a vectorized
+ * implementation at runtime. Rows are handed over in batches so that the kernels can
+ * interleave several of them, and the batches are spread over several threads for large
+ * images. Every row is blurred on its own, so the result doesn't depend on the threading.
+ */
+template<const bool alphaOnly>
+static inline void qt_blurrows(QImage &im, const int alpha, const bool improvedQuality, const int threadCount)
+{
+    const BlurKernels::KernelTable &kernels = BlurKernels::kernels();
+    // RGB888 has no kernel of its own, each of its channels is blurred as an 8-bit line.
+    const int channels = (im.depth() == 24) ? 3 : 1;
+    const BlurKernels::LineKernel kernel = (alphaOnly || (channels == 3)) ? kernels.alpha8 : kernels.argb32;
+    // The alpha channel of a 32-bit pixel is one byte inside of it, 8-bit images are
+    // blurred as they are.
+    const int offset = (alphaOnly && (im.depth() == 32)) ? qt_alphaOffset(im.format()) : 0;
+    const qsizetype step = im.depth() >> 3;
+    const qsizetype bytesPerLine = im.bytesPerLine();
+    const int im_width = im.width();
+    const int im_height = im.height();
+    uchar *bits = im.bits() + offset;
+    constexpr int batchSize = 16;
+    BlurKernels::parallelFor(im_height, qt_blurBandSize(im_height, threadCount, batchSize), threadCount, [&](const int begin, const int end, const int) {
+        uchar *lines[batchSize * 3];
+        for (int row = begin; row < end; row += batchSize) {
+            const int count = qMin(batchSize, end - row);
+            for (int index = 0; index < count; ++index) {
+                for (int channel = 0; channel < channels; ++channel) {
+                    lines[index * channels + channel] = bits + (row + index) * bytesPerLine + channel;
+                }
+            }
+            for (int i = 0; i <= int(improvedQuality); ++i) {
+                kernel(lines, count * channels, im_width, step, alpha);
+            }
+        }
+    });
+}
+
+/*
+ * Qt blurs the columns by rotating the image, blurring its rows and rotating it back.
+ * We blur them in place instead: the image is cut into strips of columns that are one
+ * cache line wide, and every column of a strip is an independent line for the kernels.
+ * Walking down a strip only touches one cache line per row, there is no full-size
+ * temporary image and no transposition at all.
+ * Rotating by 270 degrees made the rows walk the columns from the bottom up, rotating
+ * by 90 degrees from the top down. "bottomUp" keeps the output identical to that.
+ */
+template<const bool alphaOnly>
+static inline void qt_blurcolumns(QImage &im, const int alpha, const bool improvedQuality, const bool bottomUp, const int threadCount)
+{
+    const BlurKernels::KernelTable &kernels = BlurKernels::kernels();
+    // The channels of RGB888 pixels are neighbouring columns of bytes, which the 8-bit
+    // kernel blurs as packed lines.
+    const bool perChannel = (im.depth() == 24);
+    const BlurKernels::LineKernel kernel = (alphaOnly || perChannel) ? kernels.alpha8 : kernels.argb32;
+    const int offset = (alphaOnly && (im.depth() == 32)) ? qt_alphaOffset(im.format()) : 0;
+    const qsizetype pixelSize = perChannel ? 1 : (im.depth() >> 3);
+    const qsizetype bytesPerLine = im.bytesPerLine();
+    const int im_width = perChannel ? (im.width() * 3) : im.width();
+    const int im_height = im.height();
+    uchar *bits = im.bits() + offset + (bottomUp ? (im_height - 1) * bytesPerLine : 0);
+    const qsizetype step = bottomUp ? -bytesPerLine : bytesPerLine;
+    constexpr int maxStripWidth = 64;
+    const int stripWidth = maxStripWidth / int(pixelSize);
+    BlurKernels::parallelFor(im_width, qt_blurBandSize(im_width, threadCount, stripWidth), threadCount, [&](const int begin, const int end, const int) {
+        uchar *lines[maxStripWidth];
+        for (int column = begin; column < end; column += stripWidth) {
+            const int count = qMin(stripWidth, end - column);
+            for (int index = 0; index < count; ++index) {
+                lines[index] = bits + (column + index) * pixelSize;
+            }
+            for (int i = 0; i <= int(improvedQuality); ++i) {
+                kernel(lines, count, im_height, step, alpha);
+            }
+        }
+    });
+}
+
+/*
+ *  expblur(QImage &img, const qreal radius)
+ *
+ *  Based on exponential blur algorithm by Jani Huhtanen
+ *
+ *  In-place blur of image 'img' with kernel
+ *  of approximate radius 'radius'.
+ *
+ *  Blurs with two sided exponential impulse
+ *  response.
+ *
+ *  The precision of the alpha parameter and of the
+ *  state parameters is fixed, see BlurKernels::AlphaPrecision
+ *  and BlurKernels::StatePrecision.
+ */
+template<const bool alphaOnly>
+static inline void expblur(QImage &img, const qreal radius, const bool improvedQuality, const bool bottomUp, const int threadCount)
+{
+    qreal _radius = radius;
+    // halve the radius if we're using two passes
+    if (improvedQuality) {
+        _radius *= 0.5;
+    }
+    Q_ASSERT((img.format() == QImage::Format_ARGB32_Premultiplied)
+             || (img.format() == QImage::Format_RGB32)
+             || (img.format() == QImage::Format_RGBA8888_Premultiplied)
+             || (img.format() == QImage::Format_RGBX8888)
+             || (img.format() == QImage::Format_RGB888)
+             || (img.format() == QImage::Format_Indexed8)
+             || (img.format() == QImage::Format_Grayscale8)
+             || (img.format() == QImage::Format_Alpha8));
+    // choose the alpha such that pixels at radius distance from a fully
+    // saturated pixel will have an alpha component of no greater than
+    // the cutOffIntensity
+    const qreal cutOffIntensity = 2;
+    constexpr int aprec = BlurKernels::AlphaPrecision;
+    const int alpha = _radius <= qreal(1e-5)
+                    ? ((1 << aprec)-1)
+                    : qRound((1<<aprec)*(1 - qPow(cutOffIntensity * (1 / qreal(255)), 1 / _radius)));
+    qt_blurrows<alphaOnly>(img, alpha, improvedQuality, threadCount);
+    qt_blurcolumns<alphaOnly>(img, alpha, improvedQuality, bottomUp, threadCount);
+}
+
+/*
+ * Box, stack and recursive Gaussian blur, see Utilities::BlurAlgorithm. These filters need
+ * the original values of a line while they write the new ones, so every line is copied into
+ * a scratch buffer, filtered there and written back. Rows first, then the columns.
+ */
+template<const bool alphaOnly>
+static inline void separableblur(QImage &img, const qreal radius, const bool improvedQuality, const Utilities::BlurAlgorithm algorithm,
+                                 const int threadCount, QVector<float> &scratch)
+{
+    Q_ASSERT(algorithm != Utilities::BlurAlgorithm::Exponential);
+    const qreal sigma = radius / 3;
+    const int channels = alphaOnly ? 1 : (img.depth() >> 3);
+    const int passes = improvedQuality ? 5 : 3;
+    // Keeps the running sums of the stack blur in range.
+    constexpr int maxRadius = 2048;
+    // Rounding a single box width to an odd number can be far off for small radii (it even
+    // rounds down to no blur at all), so some of the passes use the next wider box to match
+    // the variance of the Gaussian (Kovesi, "Fast Almost-Gaussian Filtering").
+    int boxWidth = int(qSqrt(12 * sigma * sigma / passes + 1));
+    if ((boxWidth % 2) == 0) {
+        --boxWidth;
+    }
+    const int narrowPasses = qBound(0, qRound((12 * sigma * sigma - passes * boxWidth * boxWidth - 4 * passes * boxWidth - 3 * passes) / (-4 * boxWidth - 4)), passes);
+    const int boxRadius = qMin((boxWidth - 1) / 2, maxRadius);
+    const int widerBoxRadius = qMin(boxRadius + 1, maxRadius);
+    const int stackRadius = qMin(qRound(qSqrt(6 * sigma * sigma + 1) - 1), maxRadius);
+    const BlurKernels::GaussianCoefficients coefficients = BlurKernels::gaussianCoefficients(sigma);
+    const auto blurLine = [&](uchar *line, const int length, const qsizetype step, float *lineScratch) {
+        switch (algorithm) {
+        case Utilities::BlurAlgorithm::Box:
+            BlurKernels::boxBlurLine(line, length, step, channels, boxRadius, narrowPasses, lineScratch);
+            BlurKernels::boxBlurLine(line, length, step, channels, widerBoxRadius, passes - narrowPasses, lineScratch);
+            break;
+        case Utilities::BlurAlgorithm::Stack:
+            BlurKernels::stackBlurLine(line, length, step, channels, stackRadius, lineScratch);
+            break;
+        default:
+            BlurKernels::gaussianBlurLine(line, length, step, channels, coefficients, lineScratch);
+            break;
+        }
+    };
+    const int offset = (alphaOnly && (img.depth() == 32)) ? qt_alphaOffset(img.format()) : 0;
+    const qsizetype pixelSize = img.depth() >> 3;
+    const qsizetype bytesPerLine = img.bytesPerLine();
+    const int img_width = img.width();
+    const int img_height = img.height();
+    uchar *bits = img.bits() + offset;
+    const qsizetype workerScratchSize = BlurKernels::lineScratchSize(qMax(img_width, img_height), channels);
+    float *scratchData = qt_reuseScratch(scratch, workerScratchSize * threadCount);
+    BlurKernels::parallelFor(img_height, qt_blurBandSize(img_height, threadCount, 16), threadCount, [&](const int begin, const int end, const int worker) {
+        float *lineScratch = scratchData + worker * workerScratchSize;
+        for (int row = begin; row < end; ++row) {
+            blurLine(bits + row * bytesPerLine, img_width, pixelSize, lineScratch);
+        }
+    });
+    // Neighbouring columns share their cache lines, so hand them out in cache line wide strips.
+    BlurKernels::parallelFor(img_width, qt_blurBandSize(img_width, threadCount, 64 / int(pixelSize)), threadCount, [&](const int begin, const int end, const int worker) {
+        float *lineScratch = scratchData + worker * workerScratchSize;
+        for (int column = begin; column < end; ++column) {
+            blurLine(bits + column * pixelSize, img_height, bytesPerLine, lineScratch);
+        }
+    });
+}
+
+BlurEngine::BlurEngine() = default;
+
+BlurEngine::~BlurEngine() = default;
+
+Utilities::BlurAlgorithm BlurEngine::getAlgorithm() const
+{
+    return m_algorithm;
+}
+
+bool BlurEngine::getImprovedQuality() const
+{
+    return m_improvedQuality;
+}
+
+int BlurEngine::getThreadCount() const
+{
+    return m_threadCount;
+}
+
+int BlurEngine::getMultiThreadingThreshold() const
+{
+    return m_multiThreadingThreshold;
+}
+
+int BlurEngine::getContentTolerance() const
+{
+    return m_contentTolerance;
+}
+
+void BlurEngine::setAlgorithm(const Utilities::BlurAlgorithm value)
+{
+    m_algorithm = value;
+}
+
+void BlurEngine::setImprovedQuality(const bool value)
+{
+    m_improvedQuality = value;
+}
+
+void BlurEngine::setThreadCount(const int value)
+{
+    m_threadCount = qMax(value, -1);
+}
+
+void BlurEngine::setMultiThreadingThreshold(const int value)
+{
+    m_multiThreadingThreshold = qMax(value, -1);
+}
+
+void BlurEngine::setContentTolerance(const int value)
+{
+    m_contentTolerance = qBound(0, value, 255);
+}
+
+void BlurEngine::blur(QImage &image, const qreal radius, const int transposed)
+{
+    if (image.isNull()) {
+        return;
+    }
+    // 8-bit images are blurred as a single channel, whatever their values stand for.
+    const bool alphaOnly = (image.depth() == 8);
+    if (!alphaOnly && !qt_isNativeBlurFormat(image.format())) {
+        image = qt_convertForBlur(image);
+    }
+    blurInPlace(image, radius, alphaOnly, transposed);
+}
+
+// How far the influence of a pixel reaches, until it's less than half a level: expblur()
+// chooses its alpha such that a pixel has faded to 2 / 255 at "radius", and the other
+// algorithms, with a standard deviation of a third of "radius", stay within that.
+static inline int qt_blurSupport(const qreal radius)
+{
+    if (radius <= qreal(1e-5)) {
+        return 0;
+    }
+    return qCeil(radius * qLn(0.5 / 255) / qLn(2.0 / 255)) + 1;
+}
+
+QRect BlurEngine::blurRegion(const QImage &source, QImage &output, const QRect &dirtyRect, const qreal radius)
+{
+    const QImage::Format format = qt_blurredFormat(source);
+    Q_ASSERT(output.size() == source.size());
+    Q_ASSERT(output.format() == format);
+    if (source.isNull() || (output.size() != source.size()) || (output.format() != format)) {
+        return {};
+    }
+    const QRect bounds = source.rect();
+    const int support = qt_blurSupport(radius);
+    const QRect updated = dirtyRect.adjusted(-support, -support, support, support) & bounds;
+    if (updated.isEmpty()) {
+        return {};
+    }
+    // The pixels of the updated area need everything within their own support. Where the
+    // window ends inside of the image its edge is far enough away to not matter, where it
+    // reaches the edge of the image the blur sees the same edge as a full one does.
+    const QRect window = updated.adjusted(-support, -support, support, support) & bounds;
+    if (format == source.format()) {
+        const qsizetype pixelSize = source.depth() >> 3;
+        qt_reuseImage(m_region, window.size(), format, source.devicePixelRatio());
+        if (format == QImage::Format_Indexed8) {
+            m_region.setColorTable(source.colorTable());
+        }
+        for (int y = 0; y < window.height(); ++y) {
+            std::memcpy(m_region.scanLine(y), source.constScanLine(window.y() + y) + window.x() * pixelSize,
+                        window.width() * pixelSize);
+        }
+    } else {
+        // Only the window is converted, the same way blur(QImage &) converts all of "source".
+        m_region = qt_convertForBlur(source.copy(window));
+    }
+    blurInPlace(m_region, radius, source.depth() == 8, 0);
+    const qsizetype pixelSize = m_region.depth() >> 3;
+    const QPoint offset = updated.topLeft() - window.topLeft();
+    for (int y = 0; y < updated.height(); ++y) {
+        std::memcpy(output.scanLine(updated.y() + y) + updated.x() * pixelSize,
+                    m_region.constScanLine(offset.y() + y) + offset.x() * pixelSize, updated.width() * pixelSize);
+    }
+    return updated;
+}
+
+// The content analysis of blur(QPainter *, ...) looks at a level whose pixels are at most a
+// quarter of the radius wide: whatever the level averages away the blur wipes out as well.
+// Images which are not much larger than the radius are skipped, expblur() fades out their
+// edges, which take up too much of them for the result to be anywhere close to a plane.
+static inline int qt_probeLevel(const QSize &size, const qreal radius)
+{
+    if (qreal(qMin(size.width(), size.height())) < (radius * 4)) {
+        return 0;
+    }
+    constexpr int minimumSize = 8;
+    int level = 0;
+    QSize levelSize = size;
+    while (((qreal(1 << (level + 1)) * 4) <= radius) && (levelSize.width() >= (minimumSize * 2))
+           && (levelSize.height() >= (minimumSize * 2))) {
+        ++level;
+        levelSize /= 2;
+    }
+    return level;
+}
+
+// The least squares fit of a plane, "mean + dx * u + dy * v", to every channel of a pyramid
+// level, "u" and "v" are the pixel coordinates of the level relative to its center.
+struct BlurPlaneFit
+{
+    int channels = 0;
+    qreal mean[4] = {};
+    qreal dx[4] = {};
+    qreal dy[4] = {};
+    qreal centerX = 0;
+    qreal centerY = 0;
+    int maxResidual = 0; // Of the worst channel, in 8-bit levels.
+    qreal rmsResidual = 0;
+};
+
+static inline BlurPlaneFit qt_fitPlane(const QImage &level)
+{
+    BlurPlaneFit fit = {};
+    fit.channels = level.depth() >> 3;
+    const int width = level.width();
+    const int height = level.height();
+    fit.centerX = qreal(width - 1) / 2;
+    fit.centerY = qreal(height - 1) / 2;
+    // On a regular grid around its center the three unknowns don't depend on each other.
+    qreal sumXX = 0;
+    qreal sumYY = 0;
+    for (int x = 0; x < width; ++x) {
+        sumXX += (x - fit.centerX) * (x - fit.centerX);
+    }
+    for (int y = 0; y < height; ++y) {
+        sumYY += (y - fit.centerY) * (y - fit.centerY);
+    }
+    sumXX *= height;
+    sumYY *= width;
+    for (int y = 0; y < height; ++y) {
+        const uchar *line = level.constScanLine(y);
+        const qreal v = y - fit.centerY;
+        for (int x = 0; x < width; ++x) {
+            const qreal u = x - fit.centerX;
+            for (int channel = 0; channel < fit.channels; ++channel) {
+                const qreal value = line[x * fit.channels + channel];
+                fit.mean[channel] += value;
+                fit.dx[channel] += u * value;
+                fit.dy[channel] += v * value;
+            }
+        }
+    }
+    for (int channel = 0; channel < fit.channels; ++channel) {
+        fit.mean[channel] /= (qreal(width) * height);
+        fit.dx[channel] = (sumXX > 0) ? (fit.dx[channel] / sumXX) : 0;
+        fit.dy[channel] = (sumYY > 0) ? (fit.dy[channel] / sumYY) : 0;
+    }
+    qreal squares = 0;
+    for (int y = 0; y < height; ++y) {
+        const uchar *line = level.constScanLine(y);
+        const qreal v = y - fit.centerY;
+        for (int x = 0; x < width; ++x) {
+            const qreal u = x - fit.centerX;
+            for (int channel = 0; channel < fit.channels; ++channel) {
+                const qreal residual = line[x * fit.channels + channel] - (fit.mean[channel] + fit.dx[channel] * u + fit.dy[channel] * v);
+                fit.maxResidual = qMax(fit.maxResidual, qCeil(qAbs(residual)));
+                squares += residual * residual;
+            }
+        }
+    }
+    fit.rmsResidual = qSqrt(squares / (qreal(width) * height * fit.channels));
+    return fit;
+}
+
+template<const int channels>
+static inline void qt_renderPlaneRow(uchar *line, const int width, const int *start, const int *step, const int alphaOffset)
+{
+    constexpr int precision = 16;
+    // Local copies, the stores into "line" could alias anything else.
+    int value[channels];
+    int increment[channels];
+    for (int channel = 0; channel < channels; ++channel) {
+        value[channel] = start[channel];
+        increment[channel] = step[channel];
+    }
+    bool constant = true;
+    for (int channel = 0; channel < channels; ++channel) {
+        constant = constant && (increment[channel] == 0);
+    }
+    for (int x = 0; x < width; ++x, line += channels) {
+        if (constant && (x == 1)) {
+            // A single color, every copy doubles the part of the row that is done.
+            uchar *first = line - channels;
+            for (int done = 1; done < width; done *= 2) {
+                std::memcpy(first + qsizetype(done) * channels, first, qsizetype(qMin(done, width - done)) * channels);
+            }
+            return;
+        }
+        uchar pixel[channels];
+        for (int channel = 0; channel < channels; ++channel) {
+            pixel[channel] = uchar(qBound(0, value[channel] >> precision, 255));
+            value[channel] += increment[channel];
+        }
+        if (alphaOffset >= 0) {
+            for (int channel = 0; channel < channels; ++channel) {
+                pixel[channel] = qMin(pixel[channel], pixel[alphaOffset]);
+            }
+        }
+        std::memcpy(line, pixel, channels);
+    }
+}
+
+// Evaluates the plane for every pixel of "image", which is "scale" times as large as the
+// level it was fitted to. The colors of premultiplied pixels are kept below their alpha.
+static inline void qt_renderPlane(QImage &image, const BlurPlaneFit &fit, const int scale, const int alphaOffset, const int threadCount)
+{
+    const int channels = fit.channels;
+    const int width = image.width();
+    const bool premultiplied = (channels == 4) && image.hasAlphaChannel();
+    // Walked along the rows in 16.16 fixed point, see qt_renderPlaneRow(), with the rounding
+    // already added in. The plane is within the tolerance of the values of the level, so it
+    // stays far away from the limits of the integer part.
+    constexpr int precision = 16;
+    constexpr qreal one = qreal(1 << precision);
+    int step[4] = {};
+    for (int channel = 0; channel < channels; ++channel) {
+        step[channel] = qRound(fit.dx[channel] / scale * one);
+    }
+    BlurKernels::parallelFor(image.height(), qt_blurBandSize(image.height(), threadCount, 16), threadCount, [&](const int begin, const int end, const int) {
+        for (int y = begin; y < end; ++y) {
+            uchar *line = image.scanLine(y);
+            // The center of the first pixel of the row in the coordinates of the level.
+            const qreal u = (qreal(0.5) / scale) - qreal(0.5) - fit.centerX;
+            const qreal v = ((y + qreal(0.5)) / scale) - qreal(0.5) - fit.centerY;
+            int value[4] = {};
+            for (int channel = 0; channel < channels; ++channel) {
+                value[channel] = qRound((fit.mean[channel] + fit.dx[channel] * u + fit.dy[channel] * v + qreal(0.5)) * one);
+            }
+            switch (channels) {
+            case 4:
+                qt_renderPlaneRow<4>(line, width, value, step, premultiplied ? alphaOffset : -1);
+                break;
+            case 3:
+                qt_renderPlaneRow<3>(line, width, value, step, -1);
+                break;
+            default:
+                qt_renderPlaneRow<1>(line, width, value, step, -1);
+                break;
+            }
+        }
+    });
+}
+
+void BlurEngine::blur(QPainter *painter, const QImage &image, const qreal radius, const bool alphaOnly, const int transposed)
+{
+    m_levelCount = -1;
+    if (image.isNull()) {
+        return;
+    }
+    QImage source = image;
+    if (!qt_isNativeBlurFormat(source.format())) {
+        source = qt_convertForBlur(source);
+    }
+    // The alpha channel is blurred as a packed 8-bit plane, which has a quarter of the pixel
+    // memory to walk through at every step of the way.
+    const bool alphaPlane = alphaOnly && (source.format() == QImage::Format_Alpha8);
+    const bool extractPlane = alphaOnly && !alphaPlane;
+    qreal _radius = radius;
+    int levelCount = 0;
+    QSize levelSize = source.size();
+    const auto canHalve = [&levelSize]() {
+        return (levelSize.width() >= 2) && (levelSize.height() >= 2);
+    };
+    if ((_radius >= 4) && canHalve()) {
+        ++levelCount;
+        levelSize /= 2;
+        _radius *= 0.5;
+    }
+    // Large radii wipe out every detail a smaller level could lose, so keep going down the
+    // pyramid as long as the blur left to do at the next level is still wide enough to hide
+    // the resampling. A radius of 128 ends up being blurred with 16 on 1/64 of the pixels.
+    while ((_radius >= (g_blurPyramidMinimumRadius * 2)) && canHalve()) {
+        ++levelCount;
+        levelSize /= 2;
+        _radius *= 0.5;
+    }
+    const int probeLevel = (m_contentTolerance > 0) ? qt_probeLevel(source.size(), radius) : 0;
+    const int deepestLevel = qMax(levelCount, probeLevel);
+    if (m_levels.size() <= deepestLevel) {
+        m_levels.resize(deepestLevel + 1);
+    }
+    if (m_upsampled.size() < deepestLevel) {
+        m_upsampled.resize(deepestLevel);
+    }
+    if (extractPlane) {
+        extractAlpha(source, m_levels[0]);
+    } else if (levelCount == 0) {
+        QImage &copy = m_levels[0];
+        qt_reuseImage(copy, source.size(), source.format(), source.devicePixelRatio());
+        const qsizetype bytesPerLine = qMin(copy.bytesPerLine(), source.bytesPerLine());
+        for (int y = 0; y < source.height(); ++y) {
+            std::memcpy(copy.scanLine(y), source.constScanLine(y), bytesPerLine);
+        }
+    }
+    if (deepestLevel > 0) {
+        downsample(extractPlane ? m_levels.at(0) : source, m_levels[1]);
+        for (int level = 2; level <= deepestLevel; ++level) {
+            downsample(m_levels.at(level - 1), m_levels[level]);
+        }
+    }
+    // Solid colors and smooth gradients, the usual plain wallpapers, come out of the blur
+    // (almost) like they went in. If every channel of the probe level is within the tolerance
+    // of a plane, the plane is the result and nothing is blurred at all. If it is only close
+    // to one on average, there is not much detail the resampling could give away, and the
+    // blur runs on the probe level with what's left of the radius.
+    bool planeRendered = false;
+    if (probeLevel > 0) {
+        BlurPlaneFit fit = qt_fitPlane(m_levels.at(probeLevel));
+        // A slope that doesn't even add up to half a level over the whole width is dropped,
+        // the rows are filled with a single color then, at the full resolution. Otherwise
+        // evaluating the plane costs more per pixel than the bilinear upsampling, which
+        // reproduces a plane anyway, so it takes the place of the blurred level.
+        const QSize probeSize = m_levels.at(probeLevel).size();
+        bool constantRows = true;
+        bool flat = true;
+        for (int channel = 0; channel < fit.channels; ++channel) {
+            constantRows = constantRows && ((qAbs(fit.dx[channel]) * probeSize.width()) <= qreal(0.5));
+            flat = flat && ((qAbs(fit.dy[channel]) * probeSize.height()) <= qreal(0.5));
+        }
+        flat = flat && constantRows;
+        // expblur() leaves a solid color as it is, but it truncates its way down a slope and
+        // ends up about one level below it, per pass. That counts against the tolerance too.
+        const int blurBias = flat ? 0 : (m_improvedQuality ? 2 : 1);
+        if ((fit.maxResidual + blurBias) <= m_contentTolerance) {
+            int planeLevel = 0;
+            if (constantRows) {
+                std::fill(std::begin(fit.dx), std::end(fit.dx), qreal(0));
+                qt_reuseImage(m_levels[0], source.size(), alphaOnly ? QImage::Format_Alpha8 : source.format(), source.devicePixelRatio());
+            } else {
+                planeLevel = levelCount;
+            }
+            QImage &plane = m_levels[planeLevel];
+            qt_renderPlane(plane, fit, 1 << (probeLevel - planeLevel), qt_alphaOffset(plane.format()), threadCountFor(plane));
+            transpose(plane, transposed);
+            levelCount = planeLevel;
+            planeRendered = true;
+        } else if ((fit.rmsResidual <= m_contentTolerance) && (probeLevel > levelCount)
+                   // Only if the probe level covers as much of the image as the usual one
+                   // does, every level drops the last row or column of an odd size.
+                   && ((m_levels.at(probeLevel).size() * (1 << probeLevel)) == (m_levels.at(levelCount).size() * (1 << levelCount)))) {
+            _radius = radius / (1 << probeLevel);
+            levelCount = probeLevel;
+        }
+    }
+    if (!planeRendered) {
+        // Grayscale8 and Alpha8 sources are blurred as they are, as a single channel, like
+        // blur(QImage &) does.
+        QImage &level = m_levels[levelCount];
+        blurInPlace(level, _radius, alphaOnly || (level.depth() == 8), transposed);
+    }
+    // Walk back up the pyramid one bilinear step per level, that is smoother than a single
+    // large one and much cheaper than letting QPainter scale the image. Every step goes back
+    // to the size of its level (transposed along with the blur), the halving dropped the last
+    // row and column of odd sizes.
+    for (int level = levelCount - 1; level >= 0; --level) {
+        QSize levelSize = (level == 0) ? source.size() : m_levels.at(level).size();
+        if (transposed != 0) {
+            levelSize.transpose();
+        }
+        upsample((level == (levelCount - 1)) ? m_levels.at(levelCount) : m_upsampled.at(level + 1), m_upsampled[level], levelSize);
+    }
+    m_levelCount = levelCount;
+    if (painter) {
+        const QImage &output = (levelCount == 0) ? m_levels.at(0) : m_upsampled.at(0);
+        painter->drawImage(QRect{QPoint{0, 0}, output.size() / output.devicePixelRatio()}, output);
+    }
+}
+
+QImage BlurEngine::getResult() const
+{
+    if (m_levelCount < 0) {
+        return {};
+    }
+    return (m_levelCount == 0) ? m_levels.at(0) : m_upsampled.at(0);
+}
+
+QImage BlurEngine::takeResult()
+{
+    if (m_levelCount < 0) {
+        return {};
+    }
+    QImage result = {};
+    result.swap((m_levelCount == 0) ? m_levels[0] : m_upsampled[0]);
+    m_levelCount = -1;
+    return result;
+}
+
+qsizetype BlurEngine::getScratchSize() const
+{
+    qsizetype size = m_transposed.sizeInBytes() + m_region.sizeInBytes();
+    for (auto &&level : qAsConst(m_levels)) {
+        size += level.sizeInBytes();
+    }
+    for (auto &&level : qAsConst(m_upsampled)) {
+        size += level.sizeInBytes();
+    }
+    size += m_lineScratch.capacity() * qsizetype(sizeof(float));
+    size += m_resampleScratch.capacity() * qsizetype(sizeof(quint16));
+    return size;
+}
+
+void BlurEngine::releaseScratch()
+{
+    m_levels.clear();
+    m_levels.squeeze();
+    m_upsampled.clear();
+    m_upsampled.squeeze();
+    m_transposed = {};
+    m_region = {};
+    m_levelCount = -1;
+    m_lineScratch.clear();
+    m_lineScratch.squeeze();
+    m_resampleScratch.clear();
+    m_resampleScratch.squeeze();
+}
+
+int BlurEngine::threadCountFor(const QImage &image) const
+{
+    const int threshold = (m_multiThreadingThreshold >= 0) ? m_multiThreadingThreshold : Utilities::getBlurMultiThreadingThreshold();
+    if ((qint64(image.width()) * qint64(image.height())) < threshold) {
+        return 1;
+    }
+    const int count = (m_threadCount >= 0) ? m_threadCount : Utilities::getBlurThreadCount();
+    return (count > 0) ? count : QThread::idealThreadCount();
+}
+
+void BlurEngine::blurInPlace(QImage &image, const qreal radius, const bool alphaOnly, const int transposed)
+{
+    const int threadCount = threadCountFor(image);
+    if (m_algorithm == Utilities::BlurAlgorithm::Exponential) {
+        if (alphaOnly) {
+            expblur<true>(image, radius, m_improvedQuality, transposed >= 0, threadCount);
+        } else {
+            expblur<false>(image, radius, m_improvedQuality, transposed >= 0, threadCount);
+        }
+    } else {
+        if (alphaOnly) {
+            separableblur<true>(image, radius, m_improvedQuality, m_algorithm, threadCount, m_lineScratch);
+        } else {
+            separableblur<false>(image, radius, m_improvedQuality, m_algorithm, threadCount, m_lineScratch);
+        }
+    }
+    transpose(image, transposed);
+}
+
+// The blur functions work in place, a transposed result is rotated into a second buffer
+// which then changes places with the image.
+void BlurEngine::transpose(QImage &image, const int transposed)
+{
+    if (transposed == 0) {
+        return;
+    }
+    qt_reuseImage(m_transposed, QSize{image.height(), image.width()}, image.format(), image.devicePixelRatio());
+    if (image.format() == QImage::Format_Indexed8) {
+        m_transposed.setColorTable(image.colorTable());
+    }
+    if (transposed > 0) {
+        BlurKernels::rotate270(image.constBits(), image.width(), image.height(), image.bytesPerLine(),
+                               m_transposed.bits(), m_transposed.bytesPerLine(), image.depth());
+    } else {
+        BlurKernels::rotate90(image.constBits(), image.width(), image.height(), image.bytesPerLine(),
+                              m_transposed.bits(), m_transposed.bytesPerLine(), image.depth());
+    }
+    image.swap(m_transposed);
+}
+
+void BlurEngine::extractAlpha(const QImage &source, QImage &dest)
+{
+    qt_reuseImage(dest, source.size(), QImage::Format_Alpha8, source.devicePixelRatio());
+    if (!source.hasAlphaChannel()) {
+        dest.fill(0xff);
+        return;
+    }
+    Q_ASSERT(source.depth() == 32);
+    const BlurKernels::ExtractAlphaKernel kernel = BlurKernels::kernels().extractAlpha;
+    const int alphaOffset = qt_alphaOffset(source.format());
+    const uchar *src = source.constBits();
+    const qsizetype srcBytesPerLine = source.bytesPerLine();
+    uchar *dst = dest.bits();
+    const qsizetype destBytesPerLine = dest.bytesPerLine();
+    const int width = source.width();
+    const int height = source.height();
+    const int threadCount = threadCountFor(source);
+    BlurKernels::parallelFor(height, qt_blurBandSize(height, threadCount, 16), threadCount, [&](const int begin, const int end, const int) {
+        kernel(src + begin * srcBytesPerLine, srcBytesPerLine, dst + begin * destBytesPerLine, destBytesPerLine, width, end - begin, alphaOffset);
+    });
+}
+
+// Both resampling directions are split into row bands of the smaller image, which are
+// what the kernels iterate over.
+void BlurEngine::downsample(const QImage &source, QImage &dest)
+{
+    Q_ASSERT((source.depth() == 32) || (source.depth() == 24) || (source.depth() == 8));
+    qt_reuseImage(dest, source.size() / 2, source.format(), source.devicePixelRatio());
+    const BlurKernels::DownsampleKernel kernel = BlurKernels::kernels().downsample;
+    const int channels = source.depth() >> 3;
+    const uchar *src = source.constBits();
+    const qsizetype srcBytesPerLine = source.bytesPerLine();
+    uchar *dst = dest.bits();
+    const qsizetype destBytesPerLine = dest.bytesPerLine();
+    const int dest_width = dest.width();
+    const int dest_height = dest.height();
+    const int threadCount = threadCountFor(source);
+    BlurKernels::parallelFor(dest_height, qt_blurBandSize(dest_height, threadCount, 16), threadCount, [&](const int begin, const int end, const int) {
+        kernel(src + 2 * begin * srcBytesPerLine, srcBytesPerLine, dst + begin * destBytesPerLine,
+               destBytesPerLine, dest_width, end - begin, channels);
+    });
+}
+
+void BlurEngine::upsample(const QImage &source, QImage &dest, const QSize &size)
+{
+    Q_ASSERT((source.depth() == 32) || (source.depth() == 24) || (source.depth() == 8));
+    const QSize scaledSize = source.size() * 2;
+    qt_reuseImage(dest, scaledSize.expandedTo(size), source.format(), source.devicePixelRatio());
+    const BlurKernels::UpsampleKernel kernel = BlurKernels::kernels().upsample;
+    const int channels = source.depth() >> 3;
+    const uchar *src = source.constBits();
+    const qsizetype srcBytesPerLine = source.bytesPerLine();
+    uchar *dst = dest.bits();
+    const qsizetype destBytesPerLine = dest.bytesPerLine();
+    const int src_width = source.width();
+    const int src_height = source.height();
+    const int threadCount = threadCountFor(dest);
+    const qsizetype workerScratchSize = BlurKernels::upsampleScratchSize(src_width, channels);
+    quint16 *scratchData = qt_reuseScratch(m_resampleScratch, workerScratchSize * threadCount);
+    BlurKernels::parallelFor(src_height, qt_blurBandSize(src_height, threadCount, 16), threadCount, [&](const int begin, const int end, const int worker) {
+        kernel(src, src_width, src_height, srcBytesPerLine, dst, destBytesPerLine, channels, begin, end,
+               scratchData + worker * workerScratchSize);
+    });
+    if (dest.size() == scaledSize) {
+        return;
+    }
+    const qsizetype pixelSize = channels;
+    const uchar *lastPixel = dst + (scaledSize.width() - 1) * pixelSize;
+    for (int y = 0; y < scaledSize.height(); ++y) {
+        for (int x = scaledSize.width(); x < dest.width(); ++x) {
+            std::memcpy(dst + y * destBytesPerLine + x * pixelSize, lastPixel + y * destBytesPerLine, pixelSize);
+        }
+    }
+    const uchar *lastRow = dst + (scaledSize.height() - 1) * destBytesPerLine;
+    for (int y = scaledSize.height(); y < dest.height(); ++y) {
+        std::memcpy(dst + y * destBytesPerLine, lastRow, dest.width() * pixelSize);
+    }
+}
+
+quint64 Utilities::getBlurFormatConversionCount()
+{
+    return g_blurFormatConversionCount.load(std::memory_order_relaxed);
+}
+
+void Utilities::resetBlurFormatConversionCount()
+{
+    g_blurFormatConversionCount.store(0, std::memory_order_relaxed);
+}
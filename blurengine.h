@@ -0,0 +1,130 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2021 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "framelesshelper_global.h"
+#include "utilities.h"
+#include <QtGui/qimage.h>
+#include <QtCore/qvector.h>
+
+QT_BEGIN_NAMESPACE
+QT_FORWARD_DECLARE_CLASS(QPainter)
+QT_END_NAMESPACE
+
+/*
+ * The stateful version of Utilities::blurImage(). The engine keeps every buffer it needs
+ * (the pyramid levels, the transposed result and the scratch lines of its threads) from
+ * one call to the next and only grows them, so blurring images of the same size over and
+ * over again doesn't allocate any pixel memory. Use one engine per thread.
+ */
+class FRAMELESSHELPER_EXPORT BlurEngine
+{
+    Q_DISABLE_COPY_MOVE(BlurEngine)
+
+public:
+    explicit BlurEngine();
+    ~BlurEngine();
+
+    Utilities::BlurAlgorithm getAlgorithm() const;
+    bool getImprovedQuality() const;
+    int getThreadCount() const;
+    int getMultiThreadingThreshold() const;
+    int getContentTolerance() const;
+
+    void setAlgorithm(const Utilities::BlurAlgorithm value);
+    void setImprovedQuality(const bool value);
+    // Negative values (the default) follow Utilities::getBlurThreadCount() and
+    // Utilities::getBlurMultiThreadingThreshold().
+    void setThreadCount(const int value);
+    void setMultiThreadingThreshold(const int value);
+    // Lets blur(QPainter *, ...) take a shortcut for images a blur would barely change,
+    // solid colors and smooth gradients, as long as the result stays within "value" 8-bit
+    // levels of a full blur (farther than three times the radius from the edges, which
+    // expblur() fades out). Zero, the default, always blurs.
+    void setContentTolerance(const int value);
+
+    // Blurs "image" in place at its full resolution, see Utilities::blurImage(). 8-bit images
+    // (Alpha8, Grayscale8 and Indexed8) are blurred as a single channel.
+    // ARGB32_Premultiplied, RGB32, RGBA8888_Premultiplied, RGBX8888 and RGB888 are blurred
+    // as they are, other formats are converted first (see
+    // Utilities::getBlurFormatConversionCount()). A transposed result is swapped into "image".
+    void blur(QImage &image, const qreal radius, const int transposed = 0);
+    // Brings "output", the result of blur(QImage &) for "source" (in the format that one
+    // converted it to, if any), up to date after "source" changed inside of "dirtyRect". Only the part of "output" which depends on the changed
+    // pixels is blurred again, from a window of "source" that is large enough for the result
+    // to match a full blur within one level, so the cost follows the size of "dirtyRect"
+    // rather than the size of the image. Returns the part of "output" that was updated.
+    QRect blurRegion(const QImage &source, QImage &output, const QRect &dirtyRect, const qreal radius);
+    // Blurs "image" down the downsample pyramid and draws the result with "painter"
+    // (if any) at the size of "image", the result has the size of "image" as well. "image"
+    // itself is left untouched. With "alphaOnly"
+    // only the alpha channel is blurred, as a packed plane, and the result is an Alpha8 image.
+    // Grayscale8 and Alpha8 images are blurred as a single channel, like blur(QImage &) does.
+    void blur(QPainter *painter, const QImage &image, const qreal radius, const bool alphaOnly, const int transposed = 0);
+    // The result of the last blur(QPainter *, ...) call. Keeping a copy of it around makes
+    // the next call allocate a new buffer.
+    QImage getResult() const;
+    // The same, but the engine lets go of the buffer: the result stays valid for as long as
+    // the caller wants, and only that buffer (not the rest of the pyramid) is allocated again
+    // by the next call.
+    QImage takeResult();
+
+    // The two resampling steps of the pyramid: "dest" becomes "source" scaled to half
+    // (2x2 box filter) or to twice (bilinear) its size. Its buffer is reused if it has the
+    // right size already. Both expect 32-bit, RGB888 or 8-bit single channel images.
+    // A "size" larger than twice the source, the size of an odd level before it was halved,
+    // is filled by repeating the last row and column, which is what the clamped edges of
+    // the bilinear filter come down to there.
+    void downsample(const QImage &source, QImage &dest);
+    void upsample(const QImage &source, QImage &dest, const QSize &size = {});
+    // "dest" becomes the alpha channel of the 32-bit "source" as an Alpha8 image, which is
+    // opaque if "source" has no alpha channel.
+    void extractAlpha(const QImage &source, QImage &dest);
+
+    qsizetype getScratchSize() const;
+    void releaseScratch();
+
+private:
+    int threadCountFor(const QImage &image) const;
+    void blurInPlace(QImage &image, const qreal radius, const bool alphaOnly, const int transposed);
+    void transpose(QImage &image, const int transposed);
+
+private:
+    Utilities::BlurAlgorithm m_algorithm = Utilities::BlurAlgorithm::Exponential;
+    bool m_improvedQuality = false;
+    int m_threadCount = -1;
+    int m_multiThreadingThreshold = -1;
+    int m_contentTolerance = 0;
+    // m_levels[0] is a copy of the source which is only needed if it is blurred as it is,
+    // or its alpha plane, m_levels[i] is the source scaled down "i" times. m_upsampled[i] is the blurred result
+    // on its way back up, at the size of m_levels[i] (m_upsampled[0] at the size of the source).
+    QVector<QImage> m_levels = {};
+    QVector<QImage> m_upsampled = {};
+    QImage m_transposed = {};
+    QImage m_region = {};
+    int m_levelCount = -1; // Of the last blur(QPainter *, ...) call, -1 if there was none.
+    QVector<float> m_lineScratch = {};
+    QVector<quint16> m_resampleScratch = {};
+};
@@ -0,0 +1,1485 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2021 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "blurkernels.h"
+#include "utilities.h"
+#include <QtGui/qrgb.h>
+#include <QtCore/qmath.h>
+#include <QtCore/qthreadpool.h>
+#include <QtCore/qrunnable.h>
+#include <QtCore/qsemaphore.h>
+#include <cstring>
+#include <memory>
+#include <atomic>
+#include <utility>
+
+#if defined(Q_PROCESSOR_X86) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#define FLH_BLUR_SSE2
+#include <immintrin.h>
+#ifdef Q_CC_MSVC
+#include <intrin.h>
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#define FLH_BLUR_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define FLH_BLUR_TARGET_AVX2
+#endif
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && (Q_BYTE_ORDER == Q_LITTLE_ENDIAN)
+#define FLH_BLUR_NEON
+#include <arm_neon.h>
+#endif
+
+/*
+ * The scalar kernels are Qt's qt_blurinner() and qt_blurinner_alphaOnly(), see utilities.cpp
+ * for where they come from. The vectorized kernels produce exactly the same output: every
+ * color channel (or every line, in the alpha only case) lives in its own 32-bit lane, and
+ * the fixed-point arithmetic is carried out in the same order with the same precision.
+ * To hide the latency of the recursive filter, several independent lines are processed
+ * at the same time.
+ */
+
+static constexpr int aprec = BlurKernels::AlphaPrecision;
+static constexpr int zprec = BlurKernels::StatePrecision;
+
+template<const int shift>
+static inline int qt_static_shift(const int value)
+{
+    if (shift == 0) {
+        return value;
+    } else if (shift > 0) {
+        return value << (uint(shift) & 0x1f);
+    } else {
+        return value >> (uint(-shift) & 0x1f);
+    }
+}
+
+static inline void qt_blurinner(uchar *bptr, int &zR, int &zG, int &zB, int &zA, const int alpha)
+{
+    QRgb *pixel = reinterpret_cast<QRgb *>(bptr);
+#define Z_MASK (0xff << zprec)
+    const int A_zprec = qt_static_shift<zprec - 24>(*pixel) & Z_MASK;
+    const int R_zprec = qt_static_shift<zprec - 16>(*pixel) & Z_MASK;
+    const int G_zprec = qt_static_shift<zprec - 8>(*pixel)  & Z_MASK;
+    const int B_zprec = qt_static_shift<zprec>(*pixel)      & Z_MASK;
+#undef Z_MASK
+    const int zR_zprec = zR >> aprec;
+    const int zG_zprec = zG >> aprec;
+    const int zB_zprec = zB >> aprec;
+    const int zA_zprec = zA >> aprec;
+    zR += alpha * (R_zprec - zR_zprec);
+    zG += alpha * (G_zprec - zG_zprec);
+    zB += alpha * (B_zprec - zB_zprec);
+    zA += alpha * (A_zprec - zA_zprec);
+#define ZA_MASK (0xff << (zprec + aprec))
+    *pixel =
+        qt_static_shift<24 - zprec - aprec>(zA & ZA_MASK)
+        | qt_static_shift<16 - zprec - aprec>(zR & ZA_MASK)
+        | qt_static_shift<8 - zprec - aprec>(zG & ZA_MASK)
+        | qt_static_shift<-zprec - aprec>(zB & ZA_MASK);
+#undef ZA_MASK
+}
+
+static inline void qt_blurinner_alphaOnly(uchar *bptr, int &z, const int alpha)
+{
+    const int A_zprec = int(*(bptr)) << zprec;
+    const int z_zprec = z >> aprec;
+    z += alpha * (A_zprec - z_zprec);
+    *(bptr) = z >> (zprec + aprec);
+}
+
+template<const bool alphaOnly>
+static inline void qt_blurline(uchar *bptr, const int length, const qsizetype step, const int alpha)
+{
+    int zR = 0, zG = 0, zB = 0, zA = 0;
+    for (int index = 0; index < length; ++index) {
+        if (alphaOnly) {
+            qt_blurinner_alphaOnly(bptr, zA, alpha);
+        } else {
+            qt_blurinner(bptr, zR, zG, zB, zA, alpha);
+        }
+        bptr += step;
+    }
+    bptr -= step;
+    for (int index = length - 2; index >= 0; --index) {
+        bptr -= step;
+        if (alphaOnly) {
+            qt_blurinner_alphaOnly(bptr, zA, alpha);
+        } else {
+            qt_blurinner(bptr, zR, zG, zB, zA, alpha);
+        }
+    }
+}
+
+template<const bool alphaOnly>
+static void blurLinesScalar(uchar * const *lines, const int count, const int length, const qsizetype step, const int alpha)
+{
+    for (int line = 0; line < count; ++line) {
+        qt_blurline<alphaOnly>(lines[line], length, step, alpha);
+    }
+}
+
+static inline quint32 loadPixel(const uchar *pixel)
+{
+    quint32 value = 0;
+    std::memcpy(&value, pixel, sizeof(value));
+    return value;
+}
+
+static inline void storePixel(uchar *pixel, const quint32 value)
+{
+    std::memcpy(pixel, &value, sizeof(value));
+}
+
+// Neighbouring columns of a packed 8-bit plane are neighbouring bytes, so one vector load
+// fetches an element of each of them.
+static inline bool linesArePacked(uchar * const *lines, const int count)
+{
+    for (int line = 1; line < count; ++line) {
+        if (lines[line] != (lines[0] + line)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef FLH_BLUR_SSE2
+
+// SSE2 has no 32-bit low multiplication. The alpha parameter always fits into 16 bits,
+// so multiply the low and the high half of "delta" separately, modulo 2^32 this gives
+// the same result as _mm_mullo_epi32(). "alpha" must hold the parameter in every 16-bit
+// element.
+static inline __m128i blurStepSse2(const __m128i value, const __m128i z, const __m128i alpha)
+{
+    const __m128i delta = _mm_sub_epi32(_mm_slli_epi32(value, zprec), _mm_srai_epi32(z, aprec));
+    const __m128i low = _mm_mullo_epi16(delta, alpha);
+    const __m128i high = _mm_mulhi_epu16(delta, alpha);
+    return _mm_add_epi32(z, _mm_add_epi32(low, _mm_slli_epi32(high, 16)));
+}
+
+static inline __m128i blurResultSse2(const __m128i z)
+{
+    return _mm_and_si128(_mm_srli_epi32(z, zprec + aprec), _mm_set1_epi32(0xff));
+}
+
+static inline __m128i blurPixelSse2(uchar *pixel, const __m128i z, const __m128i alpha)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bytes = _mm_cvtsi32_si128(int(loadPixel(pixel)));
+    const __m128i value = _mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero);
+    const __m128i result = blurStepSse2(value, z, alpha);
+    __m128i packed = blurResultSse2(result);
+    packed = _mm_packs_epi32(packed, packed);
+    packed = _mm_packus_epi16(packed, packed);
+    storePixel(pixel, quint32(_mm_cvtsi128_si32(packed)));
+    return result;
+}
+
+// One vector holds the four channels of one pixel, "lanes" lines are interleaved.
+template<const int lanes>
+static inline void blurArgb32GroupSse2(uchar * const *lines, const int length, const qsizetype step, const __m128i alpha)
+{
+    __m128i z[lanes];
+    for (int lane = 0; lane < lanes; ++lane) {
+        z[lane] = _mm_setzero_si128();
+    }
+    qsizetype offset = 0;
+    for (int index = 0; index < length; ++index, offset += step) {
+        for (int lane = 0; lane < lanes; ++lane) {
+            z[lane] = blurPixelSse2(lines[lane] + offset, z[lane], alpha);
+        }
+    }
+    offset -= step;
+    for (int index = length - 2; index >= 0; --index) {
+        offset -= step;
+        for (int lane = 0; lane < lanes; ++lane) {
+            z[lane] = blurPixelSse2(lines[lane] + offset, z[lane], alpha);
+        }
+    }
+}
+
+static void blurArgb32Sse2(uchar * const *lines, const int count, const int length, const qsizetype step, const int alpha)
+{
+    const __m128i alphaVector = _mm_set1_epi16(short(alpha));
+    int line = 0;
+    for (; (line + 8) <= count; line += 8) {
+        blurArgb32GroupSse2<8>(lines + line, length, step, alphaVector);
+    }
+    for (; (line + 4) <= count; line += 4) {
+        blurArgb32GroupSse2<4>(lines + line, length, step, alphaVector);
+    }
+    for (; line < count; ++line) {
+        blurArgb32GroupSse2<1>(lines + line, length, step, alphaVector);
+    }
+}
+
+// One vector holds one element of four different lines.
+template<const int vectors>
+static inline void blurAlpha8ElementSse2(uchar * const *lines, const qsizetype offset, __m128i *z, const __m128i alpha)
+{
+    for (int vector = 0; vector < vectors; ++vector) {
+        uchar * const *group = lines + (vector * 4);
+        const __m128i value = _mm_setr_epi32(group[0][offset], group[1][offset], group[2][offset], group[3][offset]);
+        z[vector] = blurStepSse2(value, z[vector], alpha);
+        const __m128i result = blurResultSse2(z[vector]);
+        group[0][offset] = uchar(_mm_extract_epi16(result, 0));
+        group[1][offset] = uchar(_mm_extract_epi16(result, 2));
+        group[2][offset] = uchar(_mm_extract_epi16(result, 4));
+        group[3][offset] = uchar(_mm_extract_epi16(result, 6));
+    }
+}
+
+template<const int vectors>
+static inline void blurAlpha8GroupSse2(uchar * const *lines, const int length, const qsizetype step, const __m128i alpha)
+{
+    __m128i z[vectors];
+    for (int vector = 0; vector < vectors; ++vector) {
+        z[vector] = _mm_setzero_si128();
+    }
+    qsizetype offset = 0;
+    for (int index = 0; index < length; ++index, offset += step) {
+        blurAlpha8ElementSse2<vectors>(lines, offset, z, alpha);
+    }
+    offset -= step;
+    for (int index = length - 2; index >= 0; --index) {
+        offset -= step;
+        blurAlpha8ElementSse2<vectors>(lines, offset, z, alpha);
+    }
+}
+
+// One vector holds the same element of sixteen packed lines.
+static inline void blurAlpha8PackedElementSse2(uchar *element, __m128i *z, const __m128i alpha)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(element));
+    const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+    const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+    z[0] = blurStepSse2(_mm_unpacklo_epi16(low, zero), z[0], alpha);
+    z[1] = blurStepSse2(_mm_unpackhi_epi16(low, zero), z[1], alpha);
+    z[2] = blurStepSse2(_mm_unpacklo_epi16(high, zero), z[2], alpha);
+    z[3] = blurStepSse2(_mm_unpackhi_epi16(high, zero), z[3], alpha);
+    const __m128i first = _mm_packs_epi32(blurResultSse2(z[0]), blurResultSse2(z[1]));
+    const __m128i second = _mm_packs_epi32(blurResultSse2(z[2]), blurResultSse2(z[3]));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(element), _mm_packus_epi16(first, second));
+}
+
+static inline void blurAlpha8PackedSse2(uchar *first, const int length, const qsizetype step, const __m128i alpha)
+{
+    __m128i z[4] = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+    uchar *element = first;
+    for (int index = 0; index < length; ++index, element += step) {
+        blurAlpha8PackedElementSse2(element, z, alpha);
+    }
+    element -= step;
+    for (int index = length - 2; index >= 0; --index) {
+        element -= step;
+        blurAlpha8PackedElementSse2(element, z, alpha);
+    }
+}
+
+static void blurAlpha8Sse2(uchar * const *lines, const int count, const int length, const qsizetype step, const int alpha)
+{
+    const __m128i alphaVector = _mm_set1_epi16(short(alpha));
+    int line = 0;
+    for (; ((line + 16) <= count) && linesArePacked(lines + line, 16); line += 16) {
+        blurAlpha8PackedSse2(lines[line], length, step, alphaVector);
+    }
+    for (; (line + 8) <= count; line += 8) {
+        blurAlpha8GroupSse2<2>(lines + line, length, step, alphaVector);
+    }
+    for (; (line + 4) <= count; line += 4) {
+        blurAlpha8GroupSse2<1>(lines + line, length, step, alphaVector);
+    }
+    blurLinesScalar<true>(lines + line, count - line, length, step, alpha);
+}
+
+FLH_BLUR_TARGET_AVX2 static inline __m256i blurStepAvx2(const __m256i value, const __m256i z, const __m256i alpha)
+{
+    const __m256i delta = _mm256_sub_epi32(_mm256_slli_epi32(value, zprec), _mm256_srai_epi32(z, aprec));
+    return _mm256_add_epi32(z, _mm256_mullo_epi32(delta, alpha));
+}
+
+FLH_BLUR_TARGET_AVX2 static inline __m256i blurResultAvx2(const __m256i z)
+{
+    return _mm256_and_si256(_mm256_srli_epi32(z, zprec + aprec), _mm256_set1_epi32(0xff));
+}
+
+// One vector holds the four channels of two pixels from two different lines.
+FLH_BLUR_TARGET_AVX2 static inline __m256i blurPixelPairAvx2(uchar *first, uchar *second, const __m256i z, const __m256i alpha)
+{
+    const __m128i bytes = _mm_unpacklo_epi32(_mm_cvtsi32_si128(int(loadPixel(first))), _mm_cvtsi32_si128(int(loadPixel(second))));
+    const __m256i result = blurStepAvx2(_mm256_cvtepu8_epi32(bytes), z, alpha);
+    const __m256i shuffle = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                             0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i packed = _mm256_shuffle_epi8(blurResultAvx2(result), shuffle);
+    storePixel(first, quint32(_mm_cvtsi128_si32(_mm256_castsi256_si128(packed))));
+    storePixel(second, quint32(_mm_cvtsi128_si32(_mm256_extracti128_si256(packed, 1))));
+    return result;
+}
+
+template<const int pairs>
+FLH_BLUR_TARGET_AVX2 static inline void blurArgb32GroupAvx2(uchar * const *lines, const int length, const qsizetype step, const __m256i alpha)
+{
+    __m256i z[pairs];
+    for (int pair = 0; pair < pairs; ++pair) {
+        z[pair] = _mm256_setzero_si256();
+    }
+    qsizetype offset = 0;
+    for (int index = 0; index < length; ++index, offset += step) {
+        for (int pair = 0; pair < pairs; ++pair) {
+            z[pair] = blurPixelPairAvx2(lines[pair * 2] + offset, lines[pair * 2 + 1] + offset, z[pair], alpha);
+        }
+    }
+    offset -= step;
+    for (int index = length - 2; index >= 0; --index) {
+        offset -= step;
+        for (int pair = 0; pair < pairs; ++pair) {
+            z[pair] = blurPixelPairAvx2(lines[pair * 2] + offset, lines[pair * 2 + 1] + offset, z[pair], alpha);
+        }
+    }
+}
+
+FLH_BLUR_TARGET_AVX2 static void blurArgb32Avx2(uchar * const *lines, const int count, const int length, const qsizetype step, const int alpha)
+{
+    const __m256i alphaVector = _mm256_set1_epi32(alpha);
+    int line = 0;
+    for (; (line + 8) <= count; line += 8) {
+        blurArgb32GroupAvx2<4>(lines + line, length, step, alphaVector);
+    }
+    for (; (line + 2) <= count; line += 2) {
+        blurArgb32GroupAvx2<1>(lines + line, length, step, alphaVector);
+    }
+    blurArgb32Sse2(lines + line, count - line, length, step, alpha);
+}
+
+// One vector holds one element of eight different lines.
+template<const int vectors>
+FLH_BLUR_TARGET_AVX2 static inline void blurAlpha8ElementAvx2(uchar * const *lines, const qsizetype offset, __m256i *z, const __m256i alpha)
+{
+    alignas(32) int result[8];
+    for (int vector = 0; vector < vectors; ++vector) {
+        uchar * const *group = lines + (vector * 8);
+        const __m256i value = _mm256_setr_epi32(group[0][offset], group[1][offset], group[2][offset], group[3][offset],
+                                                group[4][offset], group[5][offset], group[6][offset], group[7][offset]);
+        z[vector] = blurStepAvx2(value, z[vector], alpha);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(result), blurResultAvx2(z[vector]));
+        for (int lane = 0; lane < 8; ++lane) {
+            group[lane][offset] = uchar(result[lane]);
+        }
+    }
+}
+
+template<const int vectors>
+FLH_BLUR_TARGET_AVX2 static inline void blurAlpha8GroupAvx2(uchar * const *lines, const int length, const qsizetype step, const __m256i alpha)
+{
+    __m256i z[vectors];
+    for (int vector = 0; vector < vectors; ++vector) {
+        z[vector] = _mm256_setzero_si256();
+    }
+    qsizetype offset = 0;
+    for (int index = 0; index < length; ++index, offset += step) {
+        blurAlpha8ElementAvx2<vectors>(lines, offset, z, alpha);
+    }
+    offset -= step;
+    for (int index = length - 2; index >= 0; --index) {
+        offset -= step;
+        blurAlpha8ElementAvx2<vectors>(lines, offset, z, alpha);
+    }
+}
+
+// Two vectors hold the same element of sixteen packed lines.
+FLH_BLUR_TARGET_AVX2 static inline void blurAlpha8PackedElementAvx2(uchar *element, __m256i *z, const __m256i alpha)
+{
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(element));
+    z[0] = blurStepAvx2(_mm256_cvtepu8_epi32(bytes), z[0], alpha);
+    z[1] = blurStepAvx2(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)), z[1], alpha);
+    // _mm256_packs_epi32() packs within the 128-bit halves, put the elements back in order.
+    const __m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(blurResultAvx2(z[0]), blurResultAvx2(z[1])), _MM_SHUFFLE(3, 1, 2, 0));
+    const __m128i result = _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(element), result);
+}
+
+FLH_BLUR_TARGET_AVX2 static inline void blurAlpha8PackedAvx2(uchar *first, const int length, const qsizetype step, const __m256i alpha)
+{
+    __m256i z[2] = {_mm256_setzero_si256(), _mm256_setzero_si256()};
+    uchar *element = first;
+    for (int index = 0; index < length; ++index, element += step) {
+        blurAlpha8PackedElementAvx2(element, z, alpha);
+    }
+    element -= step;
+    for (int index = length - 2; index >= 0; --index) {
+        element -= step;
+        blurAlpha8PackedElementAvx2(element, z, alpha);
+    }
+}
+
+FLH_BLUR_TARGET_AVX2 static void blurAlpha8Avx2(uchar * const *lines, const int count, const int length, const qsizetype step, const int alpha)
+{
+    const __m256i alphaVector = _mm256_set1_epi32(alpha);
+    int line = 0;
+    for (; ((line + 16) <= count) && linesArePacked(lines + line, 16); line += 16) {
+        blurAlpha8PackedAvx2(lines[line], length, step, alphaVector);
+    }
+    for (; (line + 16) <= count; line += 16) {
+        blurAlpha8GroupAvx2<2>(lines + line, length, step, alphaVector);
+    }
+    for (; (line + 8) <= count; line += 8) {
+        blurAlpha8GroupAvx2<1>(lines + line, length, step, alphaVector);
+    }
+    blurAlpha8Sse2(lines + line, count - line, length, step, alpha);
+}
+
+static inline bool cpuHasAvx2()
+{
+#ifdef Q_CC_MSVC
+    int info[4] = {};
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    // The CPU must support AVX and the OS must save the YMM registers (OSXSAVE + XCR0).
+    const int avxAndOsxsave = (1 << 27) | (1 << 28);
+    if ((info[2] & avxAndOsxsave) != avxAndOsxsave) {
+        return false;
+    }
+    if ((_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // FLH_BLUR_SSE2
+
+#ifdef FLH_BLUR_NEON
+
+static inline int32x4_t blurStepNeon(const int32x4_t value, const int32x4_t z, const int32x4_t alpha)
+{
+    const int32x4_t delta = vsubq_s32(vshlq_n_s32(value, zprec), vshrq_n_s32(z, aprec));
+    return vmlaq_s32(z, delta, alpha);
+}
+
+static inline uint32x4_t blurResultNeon(const int32x4_t z)
+{
+    return vandq_u32(vshrq_n_u32(vreinterpretq_u32_s32(z), zprec + aprec), vdupq_n_u32(0xff));
+}
+
+static inline int32x4_t blurPixelNeon(uchar *pixel, const int32x4_t z, const int32x4_t alpha)
+{
+    const uint8x8_t bytes = vreinterpret_u8_u32(vdup_n_u32(loadPixel(pixel)));
+    const int32x4_t value = vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(vmovl_u8(bytes))));
+    const int32x4_t result = blurStepNeon(value, z, alpha);
+    const uint16x4_t narrow = vmovn_u32(blurResultNeon(result));
+    const uint8x8_t packed = vmovn_u16(vcombine_u16(narrow, narrow));
+    storePixel(pixel, vget_lane_u32(vreinterpret_u32_u8(packed), 0));
+    return result;
+}
+
+template<const int lanes>
+static inline void blurArgb32GroupNeon(uchar * const *lines, const int length, const qsizetype step, const int32x4_t alpha)
+{
+    int32x4_t z[lanes];
+    for (int lane = 0; lane < lanes; ++lane) {
+        z[lane] = vdupq_n_s32(0);
+    }
+    qsizetype offset = 0;
+    for (int index = 0; index < length; ++index, offset += step) {
+        for (int lane = 0; lane < lanes; ++lane) {
+            z[lane] = blurPixelNeon(lines[lane] + offset, z[lane], alpha);
+        }
+    }
+    offset -= step;
+    for (int index = length - 2; index >= 0; --index) {
+        offset -= step;
+        for (int lane = 0; lane < lanes; ++lane) {
+            z[lane] = blurPixelNeon(lines[lane] + offset, z[lane], alpha);
+        }
+    }
+}
+
+static void blurArgb32Neon(uchar * const *lines, const int count, const int length, const qsizetype step, const int alpha)
+{
+    const int32x4_t alphaVector = vdupq_n_s32(alpha);
+    int line = 0;
+    for (; (line + 4) <= count; line += 4) {
+        blurArgb32GroupNeon<4>(lines + line, length, step, alphaVector);
+    }
+    for (; line < count; ++line) {
+        blurArgb32GroupNeon<1>(lines + line, length, step, alphaVector);
+    }
+}
+
+template<const int vectors>
+static inline void blurAlpha8ElementNeon(uchar * const *lines, const qsizetype offset, int32x4_t *z, const int32x4_t alpha)
+{
+    for (int vector = 0; vector < vectors; ++vector) {
+        uchar * const *group = lines + (vector * 4);
+        int32x4_t value = vdupq_n_s32(group[0][offset]);
+        value = vsetq_lane_s32(group[1][offset], value, 1);
+        value = vsetq_lane_s32(group[2][offset], value, 2);
+        value = vsetq_lane_s32(group[3][offset], value, 3);
+        z[vector] = blurStepNeon(value, z[vector], alpha);
+        const uint32x4_t result = blurResultNeon(z[vector]);
+        group[0][offset] = uchar(vgetq_lane_u32(result, 0));
+        group[1][offset] = uchar(vgetq_lane_u32(result, 1));
+        group[2][offset] = uchar(vgetq_lane_u32(result, 2));
+        group[3][offset] = uchar(vgetq_lane_u32(result, 3));
+    }
+}
+
+template<const int vectors>
+static inline void blurAlpha8GroupNeon(uchar * const *lines, const int length, const qsizetype step, const int32x4_t alpha)
+{
+    int32x4_t z[vectors];
+    for (int vector = 0; vector < vectors; ++vector) {
+        z[vector] = vdupq_n_s32(0);
+    }
+    qsizetype offset = 0;
+    for (int index = 0; index < length; ++index, offset += step) {
+        blurAlpha8ElementNeon<vectors>(lines, offset, z, alpha);
+    }
+    offset -= step;
+    for (int index = length - 2; index >= 0; --index) {
+        offset -= step;
+        blurAlpha8ElementNeon<vectors>(lines, offset, z, alpha);
+    }
+}
+
+// One vector holds the same element of sixteen packed lines.
+static inline void blurAlpha8PackedElementNeon(uchar *element, int32x4_t *z, const int32x4_t alpha)
+{
+    const uint8x16_t bytes = vld1q_u8(element);
+    const uint16x8_t low = vmovl_u8(vget_low_u8(bytes));
+    const uint16x8_t high = vmovl_u8(vget_high_u8(bytes));
+    z[0] = blurStepNeon(vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(low))), z[0], alpha);
+    z[1] = blurStepNeon(vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(low))), z[1], alpha);
+    z[2] = blurStepNeon(vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(high))), z[2], alpha);
+    z[3] = blurStepNeon(vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(high))), z[3], alpha);
+    const uint16x8_t first = vcombine_u16(vmovn_u32(blurResultNeon(z[0])), vmovn_u32(blurResultNeon(z[1])));
+    const uint16x8_t second = vcombine_u16(vmovn_u32(blurResultNeon(z[2])), vmovn_u32(blurResultNeon(z[3])));
+    vst1q_u8(element, vcombine_u8(vmovn_u16(first), vmovn_u16(second)));
+}
+
+static inline void blurAlpha8PackedNeon(uchar *first, const int length, const qsizetype step, const int32x4_t alpha)
+{
+    int32x4_t z[4] = {vdupq_n_s32(0), vdupq_n_s32(0), vdupq_n_s32(0), vdupq_n_s32(0)};
+    uchar *element = first;
+    for (int index = 0; index < length; ++index, element += step) {
+        blurAlpha8PackedElementNeon(element, z, alpha);
+    }
+    element -= step;
+    for (int index = length - 2; index >= 0; --index) {
+        element -= step;
+        blurAlpha8PackedElementNeon(element, z, alpha);
+    }
+}
+
+static void blurAlpha8Neon(uchar * const *lines, const int count, const int length, const qsizetype step, const int alpha)
+{
+    const int32x4_t alphaVector = vdupq_n_s32(alpha);
+    int line = 0;
+    for (; ((line + 16) <= count) && linesArePacked(lines + line, 16); line += 16) {
+        blurAlpha8PackedNeon(lines[line], length, step, alphaVector);
+    }
+    for (; (line + 8) <= count; line += 8) {
+        blurAlpha8GroupNeon<2>(lines + line, length, step, alphaVector);
+    }
+    for (; (line + 4) <= count; line += 4) {
+        blurAlpha8GroupNeon<1>(lines + line, length, step, alphaVector);
+    }
+    blurLinesScalar<true>(lines + line, count - line, length, step, alpha);
+}
+
+#endif // FLH_BLUR_NEON
+
+static inline quint32 averagePixels(const quint32 a, const quint32 b)
+{
+    // The AVG() macro of qt_halfScaled(): the average of every byte, rounded down.
+    return (((a ^ b) & 0xfefefefeu) >> 1) + (a & b);
+}
+
+static inline void downsampleRowScalar(const uchar *p1, const uchar *p2, uchar *dest, const int begin, const int width, const int channels)
+{
+    if (channels == 4) {
+        for (int x = begin; x < width; ++x) {
+            const quint32 top = averagePixels(loadPixel(p1 + x * 8), loadPixel(p1 + x * 8 + 4));
+            const quint32 bottom = averagePixels(loadPixel(p2 + x * 8), loadPixel(p2 + x * 8 + 4));
+            storePixel(dest + x * 4, averagePixels(top, bottom));
+        }
+    } else if (channels == 3) {
+        // Rounded down in two steps as well, so that RGB888 comes out like RGB32 does.
+        for (int i = begin * 3; i < (width * 3); ++i) {
+            const int pixel = i / 3;
+            const int channel = i - (pixel * 3);
+            const int top = (int(p1[pixel * 6 + channel]) + int(p1[pixel * 6 + 3 + channel])) >> 1;
+            const int bottom = (int(p2[pixel * 6 + channel]) + int(p2[pixel * 6 + 3 + channel])) >> 1;
+            dest[i] = uchar((top + bottom) >> 1);
+        }
+    } else {
+        for (int x = begin; x < width; ++x) {
+            dest[x] = uchar((int(p1[x * 2]) + int(p1[x * 2 + 1]) + int(p2[x * 2]) + int(p2[x * 2 + 1]) + 2) >> 2);
+        }
+    }
+}
+
+static void downsampleScalar(const uchar *src, const qsizetype srcBytesPerLine, uchar *dest, const qsizetype destBytesPerLine,
+                             const int width, const int height, const int channels)
+{
+    for (int y = 0; y < height; ++y, src += 2 * srcBytesPerLine, dest += destBytesPerLine) {
+        downsampleRowScalar(src, src + srcBytesPerLine, dest, 0, width, channels);
+    }
+}
+
+// The vertical half of the upsampling: "3 * center + neighbour" for every value of a row. The
+// result is kept at 16 bits, so the horizontal half can round only once at the end.
+static inline void upsampleColumnsScalar(const uchar *center, const uchar *neighbour, quint16 *out, const int begin, const int count)
+{
+    for (int i = begin; i < count; ++i) {
+        out[i] = quint16(3 * int(center[i]) + int(neighbour[i]));
+    }
+}
+
+// The horizontal half. "line" has one extra pixel before and after the row which repeats
+// the edge, the weights of both halves add up to 16.
+static inline void upsampleRowsScalar(const quint16 *line, uchar *dest, const int begin, const int width, const int channels)
+{
+    for (int x = begin; x < width; ++x) {
+        const quint16 *pixel = line + x * channels;
+        uchar *even = dest + 2 * x * channels;
+        uchar *odd = even + channels;
+        for (int channel = 0; channel < channels; ++channel) {
+            const int value = 3 * int(pixel[channel]) + 8;
+            even[channel] = uchar((value + int(pixel[channel - channels])) >> 4);
+            odd[channel] = uchar((value + int(pixel[channel + channels])) >> 4);
+        }
+    }
+}
+
+static inline void padUpsampleLine(quint16 *line, const int width, const int channels)
+{
+    for (int channel = 0; channel < channels; ++channel) {
+        line[channel - channels] = line[channel];
+        line[width * channels + channel] = line[(width - 1) * channels + channel];
+    }
+}
+
+template<typename Columns, typename Rows>
+static inline void upsampleWith(const uchar *src, const int width, const int height, const qsizetype srcBytesPerLine,
+                                uchar *dest, const qsizetype destBytesPerLine, const int channels, const int begin, const int end,
+                                quint16 *scratch, Columns columns, Rows rows)
+{
+    const int count = width * channels;
+    const int padded = count + 2 * channels;
+    quint16 *upper = scratch + channels;
+    quint16 *lower = upper + padded;
+    for (int y = begin; y < end; ++y) {
+        const uchar *center = src + y * srcBytesPerLine;
+        const uchar *above = src + qMax(y - 1, 0) * srcBytesPerLine;
+        const uchar *below = src + qMin(y + 1, height - 1) * srcBytesPerLine;
+        columns(center, above, upper, count);
+        columns(center, below, lower, count);
+        padUpsampleLine(upper, width, channels);
+        padUpsampleLine(lower, width, channels);
+        uchar *even = dest + 2 * y * destBytesPerLine;
+        rows(upper, even, width, channels);
+        rows(lower, even + destBytesPerLine, width, channels);
+    }
+}
+
+static void upsampleScalar(const uchar *src, const int width, const int height, const qsizetype srcBytesPerLine,
+                           uchar *dest, const qsizetype destBytesPerLine, const int channels, const int begin, const int end,
+                           quint16 *scratch)
+{
+    upsampleWith(src, width, height, srcBytesPerLine, dest, destBytesPerLine, channels, begin, end, scratch,
+                 [](const uchar *center, const uchar *neighbour, quint16 *out, const int count) {
+                     upsampleColumnsScalar(center, neighbour, out, 0, count);
+                 },
+                 [](const quint16 *line, uchar *out, const int width, const int channels) {
+                     upsampleRowsScalar(line, out, 0, width, channels);
+                 });
+}
+
+static inline void extractAlphaRowScalar(const uchar *src, uchar *dest, const int begin, const int width, const int alphaOffset)
+{
+    for (int x = begin; x < width; ++x) {
+        dest[x] = src[x * 4 + alphaOffset];
+    }
+}
+
+static void extractAlphaScalar(const uchar *src, const qsizetype srcBytesPerLine, uchar *dest, const qsizetype destBytesPerLine,
+                               const int width, const int height, const int alphaOffset)
+{
+    for (int y = 0; y < height; ++y, src += srcBytesPerLine, dest += destBytesPerLine) {
+        extractAlphaRowScalar(src, dest, 0, width, alphaOffset);
+    }
+}
+
+// Qt's BYTE_MUL(): every 8-bit value of "x" times "a" / 255, rounded.
+static inline quint32 byteMul(const quint32 x, const quint32 a)
+{
+    quint32 t = (x & 0xff00ff) * a;
+    t = (t + ((t >> 8) & 0xff00ff) + 0x800080) >> 8;
+    t &= 0xff00ff;
+    quint32 u = ((x >> 8) & 0xff00ff) * a;
+    u = (u + ((u >> 8) & 0xff00ff) + 0x800080);
+    u &= 0xff00ff00;
+    return u | t;
+}
+
+static inline void sourceOverRowScalar(uchar *dest, const uchar *src, const int begin, const int count, const int opacity)
+{
+    for (int x = begin; x < count; ++x) {
+        quint32 s = loadPixel(src + x * 4);
+        if (opacity != 255) {
+            s = byteMul(s, quint32(opacity));
+        }
+        storePixel(dest + x * 4, s + byteMul(loadPixel(dest + x * 4), 255 - (s >> 24)));
+    }
+}
+
+static void sourceOverScalar(uchar *dest, const uchar *src, const int count, const int opacity)
+{
+    sourceOverRowScalar(dest, src, 0, count, opacity);
+}
+
+// Qt's INTERPOLATE_PIXEL_256(), "a" and "b" add up to 256.
+static inline quint32 interpolatePixel256(const quint32 x, const quint32 a, const quint32 y, const quint32 b)
+{
+    quint32 t = (x & 0xff00ff) * a + (y & 0xff00ff) * b;
+    t >>= 8;
+    t &= 0xff00ff;
+    quint32 u = ((x >> 8) & 0xff00ff) * a + ((y >> 8) & 0xff00ff) * b;
+    u &= 0xff00ff00;
+    return u | t;
+}
+
+static inline void interpolateRowsScalar(const uchar *row0, const uchar *row1, const int weight, uchar *dest, const int begin, const int count)
+{
+    for (int x = begin; x < count; ++x) {
+        storePixel(dest + x * 4, interpolatePixel256(loadPixel(row0 + x * 4), quint32(256 - weight), loadPixel(row1 + x * 4), quint32(weight)));
+    }
+}
+
+static void interpolateRowsScalar(const uchar *row0, const uchar *row1, const int weight, uchar *dest, const int count)
+{
+    if (weight == 0) {
+        std::memcpy(dest, row0, size_t(count) * 4);
+        return;
+    }
+    interpolateRowsScalar(row0, row1, weight, dest, 0, count);
+}
+
+static inline void interpolateColumnsScalar(const uchar *src, const int *offsets, const quint16 *weights, uchar *dest, const int begin, const int count)
+{
+    for (int x = begin; x < count; ++x) {
+        const uchar *pixel = src + offsets[x] * 4;
+        storePixel(dest + x * 4, interpolatePixel256(loadPixel(pixel), quint32(256 - weights[x]), loadPixel(pixel + 4), quint32(weights[x])));
+    }
+}
+
+static void interpolateColumnsScalar(const uchar *src, const int *offsets, const quint16 *weights, uchar *dest, const int count)
+{
+    interpolateColumnsScalar(src, offsets, weights, dest, 0, count);
+}
+
+#ifdef FLH_BLUR_SSE2
+
+static inline __m128i floorAverageSse2(const __m128i a, const __m128i b)
+{
+    // _mm_avg_epu8() rounds up, averagePixels() rounds down.
+    return _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+}
+
+static inline __m128i averageNeighboursSse2(const uchar *pixels)
+{
+    const __m128 first = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels)));
+    const __m128 second = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + 16)));
+    const __m128i even = _mm_castps_si128(_mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0)));
+    const __m128i odd = _mm_castps_si128(_mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1)));
+    return floorAverageSse2(even, odd);
+}
+
+static inline __m128i sumNeighboursSse2(const __m128i values)
+{
+    return _mm_add_epi16(_mm_and_si128(values, _mm_set1_epi16(0xff)), _mm_srli_epi16(values, 8));
+}
+
+static void downsampleSse2(const uchar *src, const qsizetype srcBytesPerLine, uchar *dest, const qsizetype destBytesPerLine,
+                           const int width, const int height, const int channels)
+{
+    const __m128i rounding = _mm_set1_epi16(2);
+    for (int y = 0; y < height; ++y, src += 2 * srcBytesPerLine, dest += destBytesPerLine) {
+        const uchar *p1 = src;
+        const uchar *p2 = src + srcBytesPerLine;
+        int x = 0;
+        if (channels == 4) {
+            for (; (x + 4) <= width; x += 4) {
+                const __m128i result = floorAverageSse2(averageNeighboursSse2(p1 + x * 8), averageNeighboursSse2(p2 + x * 8));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + x * 4), result);
+            }
+        } else if (channels == 1) {
+            for (; (x + 16) <= width; x += 16) {
+                const __m128i top1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p1 + x * 2));
+                const __m128i top2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p1 + x * 2 + 16));
+                const __m128i bottom1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p2 + x * 2));
+                const __m128i bottom2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p2 + x * 2 + 16));
+                const __m128i sum1 = _mm_add_epi16(_mm_add_epi16(sumNeighboursSse2(top1), sumNeighboursSse2(bottom1)), rounding);
+                const __m128i sum2 = _mm_add_epi16(_mm_add_epi16(sumNeighboursSse2(top2), sumNeighboursSse2(bottom2)), rounding);
+                const __m128i result = _mm_packus_epi16(_mm_srli_epi16(sum1, 2), _mm_srli_epi16(sum2, 2));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + x), result);
+            }
+        }
+        downsampleRowScalar(p1, p2, dest, x, width, channels);
+    }
+}
+
+static inline void upsampleColumnsSse2(const uchar *center, const uchar *neighbour, quint16 *out, const int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; (i + 16) <= count; i += 16) {
+        const __m128i n = _mm_loadu_si128(reinterpret_cast<const __m128i *>(center + i));
+        const __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i *>(neighbour + i));
+        const __m128i nLow = _mm_unpacklo_epi8(n, zero);
+        const __m128i nHigh = _mm_unpackhi_epi8(n, zero);
+        const __m128i low = _mm_add_epi16(_mm_add_epi16(nLow, _mm_slli_epi16(nLow, 1)), _mm_unpacklo_epi8(f, zero));
+        const __m128i high = _mm_add_epi16(_mm_add_epi16(nHigh, _mm_slli_epi16(nHigh, 1)), _mm_unpackhi_epi8(f, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), low);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + 8), high);
+    }
+    upsampleColumnsScalar(center, neighbour, out, i, count);
+}
+
+static inline void upsampleRowsSse2(const quint16 *line, uchar *dest, const int width, const int channels)
+{
+    const __m128i rounding = _mm_set1_epi16(8);
+    // Three channels don't line up with the lanes, RGB888 rows are done by the scalar code.
+    const int count = (channels == 3) ? 0 : (width * channels);
+    int i = 0;
+    for (; (i + 8) <= count; i += 8) {
+        const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(line + i));
+        const __m128i previous = _mm_loadu_si128(reinterpret_cast<const __m128i *>(line + i - channels));
+        const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i *>(line + i + channels));
+        const __m128i center = _mm_add_epi16(_mm_add_epi16(value, _mm_slli_epi16(value, 1)), rounding);
+        const __m128i even = _mm_srli_epi16(_mm_add_epi16(center, previous), 4);
+        const __m128i odd = _mm_srli_epi16(_mm_add_epi16(center, next), 4);
+        // Every source pixel becomes an even and an odd destination pixel next to each other.
+        const __m128i low = (channels == 4) ? _mm_unpacklo_epi64(even, odd) : _mm_unpacklo_epi16(even, odd);
+        const __m128i high = (channels == 4) ? _mm_unpackhi_epi64(even, odd) : _mm_unpackhi_epi16(even, odd);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 2 * i), _mm_packus_epi16(low, high));
+    }
+    upsampleRowsScalar(line, dest, i / channels, width, channels);
+}
+
+static void upsampleSse2(const uchar *src, const int width, const int height, const qsizetype srcBytesPerLine,
+                         uchar *dest, const qsizetype destBytesPerLine, const int channels, const int begin, const int end,
+                         quint16 *scratch)
+{
+    upsampleWith(src, width, height, srcBytesPerLine, dest, destBytesPerLine, channels, begin, end, scratch,
+                 upsampleColumnsSse2, upsampleRowsSse2);
+}
+
+static void extractAlphaSse2(const uchar *src, const qsizetype srcBytesPerLine, uchar *dest, const qsizetype destBytesPerLine,
+                             const int width, const int height, const int alphaOffset)
+{
+    // x86 is little endian, the last byte of a pixel is the top one of its 32-bit value.
+    if (alphaOffset != 3) {
+        extractAlphaScalar(src, srcBytesPerLine, dest, destBytesPerLine, width, height, alphaOffset);
+        return;
+    }
+    for (int y = 0; y < height; ++y, src += srcBytesPerLine, dest += destBytesPerLine) {
+        int x = 0;
+        for (; (x + 16) <= width; x += 16) {
+            // The alpha values fit into 16 bits once they are shifted down, so the signed
+            // saturation of _mm_packs_epi32() never kicks in.
+            const __m128i a1 = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4)), 24);
+            const __m128i a2 = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4 + 16)), 24);
+            const __m128i a3 = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4 + 32)), 24);
+            const __m128i a4 = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4 + 48)), 24);
+            const __m128i result = _mm_packus_epi16(_mm_packs_epi32(a1, a2), _mm_packs_epi32(a3, a4));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + x), result);
+        }
+        extractAlphaRowScalar(src, dest, x, width, alphaOffset);
+    }
+}
+
+// BYTE_MUL() on the red/blue and the alpha/green pairs, like Qt's BYTE_MUL_SSE2(). "alpha"
+// holds the factor of every pixel in both 16-bit halves of its lane.
+static inline __m128i byteMulSse2(const __m128i x, const __m128i alpha)
+{
+    const __m128i colorMask = _mm_set1_epi32(0x00ff00ff);
+    const __m128i half = _mm_set1_epi16(0x80);
+    __m128i rb = _mm_mullo_epi16(_mm_and_si128(x, colorMask), alpha);
+    __m128i ag = _mm_mullo_epi16(_mm_srli_epi16(x, 8), alpha);
+    rb = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(rb, _mm_srli_epi16(rb, 8)), half), 8);
+    ag = _mm_andnot_si128(colorMask, _mm_add_epi16(_mm_add_epi16(ag, _mm_srli_epi16(ag, 8)), half));
+    return _mm_or_si128(rb, ag);
+}
+
+static void sourceOverSse2(uchar *dest, const uchar *src, const int count, const int opacity)
+{
+    const __m128i full = _mm_set1_epi16(0xff);
+    const __m128i constantAlpha = _mm_set1_epi16(short(opacity));
+    int x = 0;
+    for (; (x + 4) <= count; x += 4) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4));
+        const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dest + x * 4));
+        if (opacity != 255) {
+            s = byteMulSse2(s, constantAlpha);
+        }
+        // 255 minus the alpha of every source pixel, in both 16-bit halves of its lane.
+        const __m128i alpha = _mm_srli_epi32(s, 24);
+        const __m128i inverse = _mm_sub_epi16(full, _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + x * 4), _mm_add_epi8(s, byteMulSse2(d, inverse)));
+    }
+    sourceOverRowScalar(dest, src, x, count, opacity);
+}
+
+// INTERPOLATE_PIXEL_256() of four pixels, "a" and "b" hold the weights of every pixel in
+// both 16-bit halves of its lane.
+static inline __m128i interpolatePixel256Sse2(const __m128i x, const __m128i a, const __m128i y, const __m128i b)
+{
+    const __m128i colorMask = _mm_set1_epi32(0x00ff00ff);
+    // At most 255 * 256 per lane, the low 16 bits of the products are all it takes.
+    __m128i rb = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(x, colorMask), a), _mm_mullo_epi16(_mm_and_si128(y, colorMask), b));
+    __m128i ag = _mm_add_epi16(_mm_mullo_epi16(_mm_srli_epi16(x, 8), a), _mm_mullo_epi16(_mm_srli_epi16(y, 8), b));
+    rb = _mm_srli_epi16(rb, 8);
+    ag = _mm_andnot_si128(colorMask, ag);
+    return _mm_or_si128(rb, ag);
+}
+
+static void interpolateRowsSse2(const uchar *row0, const uchar *row1, const int weight, uchar *dest, const int count)
+{
+    if (weight == 0) {
+        std::memcpy(dest, row0, size_t(count) * 4);
+        return;
+    }
+    const __m128i a = _mm_set1_epi16(short(256 - weight));
+    const __m128i b = _mm_set1_epi16(short(weight));
+    int x = 0;
+    for (; (x + 4) <= count; x += 4) {
+        const __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 4));
+        const __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + x * 4), interpolatePixel256Sse2(p0, a, p1, b));
+    }
+    interpolateRowsScalar(row0, row1, weight, dest, x, count);
+}
+
+static void interpolateColumnsSse2(const uchar *src, const int *offsets, const quint16 *weights, uchar *dest, const int count)
+{
+    const __m128i full = _mm_set1_epi16(256);
+    int x = 0;
+    for (; (x + 4) <= count; x += 4) {
+        // Both neighbours of every destination pixel at once, then the left and the right ones apart.
+        const __m128i pairs01 = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + offsets[x] * 4)),
+                                                   _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + offsets[x + 1] * 4)));
+        const __m128i pairs23 = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + offsets[x + 2] * 4)),
+                                                   _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + offsets[x + 3] * 4)));
+        const __m128i left = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(pairs01), _mm_castsi128_ps(pairs23), _MM_SHUFFLE(2, 0, 2, 0)));
+        const __m128i right = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(pairs01), _mm_castsi128_ps(pairs23), _MM_SHUFFLE(3, 1, 3, 1)));
+        const __m128i weight = _mm_set_epi32(weights[x + 3], weights[x + 2], weights[x + 1], weights[x]);
+        const __m128i b = _mm_or_si128(weight, _mm_slli_epi32(weight, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + x * 4), interpolatePixel256Sse2(left, _mm_sub_epi16(full, b), right, b));
+    }
+    interpolateColumnsScalar(src, offsets, weights, dest, x, count);
+}
+
+#endif // FLH_BLUR_SSE2
+
+#ifdef FLH_BLUR_NEON
+
+static void downsampleNeon(const uchar *src, const qsizetype srcBytesPerLine, uchar *dest, const qsizetype destBytesPerLine,
+                           const int width, const int height, const int channels)
+{
+    for (int y = 0; y < height; ++y, src += 2 * srcBytesPerLine, dest += destBytesPerLine) {
+        const uchar *p1 = src;
+        const uchar *p2 = src + srcBytesPerLine;
+        int x = 0;
+        if (channels == 4) {
+            for (; (x + 4) <= width; x += 4) {
+                // vhaddq_u8() rounds down, just like averagePixels().
+                const uint32x4x2_t top = vld2q_u32(reinterpret_cast<const uint32_t *>(p1 + x * 8));
+                const uint32x4x2_t bottom = vld2q_u32(reinterpret_cast<const uint32_t *>(p2 + x * 8));
+                const uint8x16_t topAverage = vhaddq_u8(vreinterpretq_u8_u32(top.val[0]), vreinterpretq_u8_u32(top.val[1]));
+                const uint8x16_t bottomAverage = vhaddq_u8(vreinterpretq_u8_u32(bottom.val[0]), vreinterpretq_u8_u32(bottom.val[1]));
+                vst1q_u8(dest + x * 4, vhaddq_u8(topAverage, bottomAverage));
+            }
+        } else if (channels == 1) {
+            for (; (x + 8) <= width; x += 8) {
+                const uint16x8_t sum = vaddq_u16(vpaddlq_u8(vld1q_u8(p1 + x * 2)), vpaddlq_u8(vld1q_u8(p2 + x * 2)));
+                vst1_u8(dest + x, vrshrn_n_u16(sum, 2));
+            }
+        }
+        downsampleRowScalar(p1, p2, dest, x, width, channels);
+    }
+}
+
+static inline void upsampleColumnsNeon(const uchar *center, const uchar *neighbour, quint16 *out, const int count)
+{
+    const uint8x8_t three = vdup_n_u8(3);
+    int i = 0;
+    for (; (i + 16) <= count; i += 16) {
+        const uint8x16_t n = vld1q_u8(center + i);
+        const uint8x16_t f = vld1q_u8(neighbour + i);
+        vst1q_u16(out + i, vmlal_u8(vmovl_u8(vget_low_u8(f)), vget_low_u8(n), three));
+        vst1q_u16(out + i + 8, vmlal_u8(vmovl_u8(vget_high_u8(f)), vget_high_u8(n), three));
+    }
+    upsampleColumnsScalar(center, neighbour, out, i, count);
+}
+
+static inline void upsampleRowsNeon(const quint16 *line, uchar *dest, const int width, const int channels)
+{
+    // Three channels don't line up with the lanes, RGB888 rows are done by the scalar code.
+    const int count = (channels == 3) ? 0 : (width * channels);
+    int i = 0;
+    for (; (i + 8) <= count; i += 8) {
+        const uint16x8_t value = vld1q_u16(line + i);
+        const uint8x8_t even = vrshrn_n_u16(vmlaq_n_u16(vld1q_u16(line + i - channels), value, 3), 4);
+        const uint8x8_t odd = vrshrn_n_u16(vmlaq_n_u16(vld1q_u16(line + i + channels), value, 3), 4);
+        if (channels == 4) {
+            const uint32x2x2_t pixels = vzip_u32(vreinterpret_u32_u8(even), vreinterpret_u32_u8(odd));
+            vst1q_u8(dest + 2 * i, vcombine_u8(vreinterpret_u8_u32(pixels.val[0]), vreinterpret_u8_u32(pixels.val[1])));
+        } else {
+            const uint8x8x2_t pixels = vzip_u8(even, odd);
+            vst1q_u8(dest + 2 * i, vcombine_u8(pixels.val[0], pixels.val[1]));
+        }
+    }
+    upsampleRowsScalar(line, dest, i / channels, width, channels);
+}
+
+static void upsampleNeon(const uchar *src, const int width, const int height, const qsizetype srcBytesPerLine,
+                         uchar *dest, const qsizetype destBytesPerLine, const int channels, const int begin, const int end,
+                         quint16 *scratch)
+{
+    upsampleWith(src, width, height, srcBytesPerLine, dest, destBytesPerLine, channels, begin, end, scratch,
+                 upsampleColumnsNeon, upsampleRowsNeon);
+}
+
+static void extractAlphaNeon(const uchar *src, const qsizetype srcBytesPerLine, uchar *dest, const qsizetype destBytesPerLine,
+                             const int width, const int height, const int alphaOffset)
+{
+    if (alphaOffset != 3) {
+        extractAlphaScalar(src, srcBytesPerLine, dest, destBytesPerLine, width, height, alphaOffset);
+        return;
+    }
+    for (int y = 0; y < height; ++y, src += srcBytesPerLine, dest += destBytesPerLine) {
+        int x = 0;
+        for (; (x + 16) <= width; x += 16) {
+            // Deinterleaves the bytes of 16 pixels, the fourth one is the alpha channel.
+            vst1q_u8(dest + x, vld4q_u8(src + x * 4).val[3]);
+        }
+        extractAlphaRowScalar(src, dest, x, width, alphaOffset);
+    }
+}
+
+// Every byte of "x" times the one of "alpha" / 255, with the rounding of BYTE_MUL(),
+// (x + (x >> 8) + 0x80) >> 8.
+static inline uint8x16_t byteMulNeon(const uint8x16_t x, const uint8x16_t alpha)
+{
+    const uint16x8_t half = vdupq_n_u16(0x80);
+    const uint16x8_t low = vmull_u8(vget_low_u8(x), vget_low_u8(alpha));
+    const uint16x8_t high = vmull_u8(vget_high_u8(x), vget_high_u8(alpha));
+    const uint8x8_t lowResult = vshrn_n_u16(vaddq_u16(vaddq_u16(low, vshrq_n_u16(low, 8)), half), 8);
+    const uint8x8_t highResult = vshrn_n_u16(vaddq_u16(vaddq_u16(high, vshrq_n_u16(high, 8)), half), 8);
+    return vcombine_u8(lowResult, highResult);
+}
+
+static void sourceOverNeon(uchar *dest, const uchar *src, const int count, const int opacity)
+{
+    const uint8x16_t constantAlpha = vdupq_n_u8(uint8_t(opacity));
+    int x = 0;
+    for (; (x + 4) <= count; x += 4) {
+        uint8x16_t s = vld1q_u8(src + x * 4);
+        const uint8x16_t d = vld1q_u8(dest + x * 4);
+        if (opacity != 255) {
+            s = byteMulNeon(s, constantAlpha);
+        }
+        // The alpha of every source pixel in all four of its bytes, 255 minus it is its complement.
+        const uint8x16_t alpha = vreinterpretq_u8_u32(vmulq_n_u32(vshrq_n_u32(vreinterpretq_u32_u8(s), 24), 0x01010101));
+        vst1q_u8(dest + x * 4, vaddq_u8(s, byteMulNeon(d, vmvnq_u8(alpha))));
+    }
+    sourceOverRowScalar(dest, src, x, count, opacity);
+}
+
+// INTERPOLATE_PIXEL_256() of eight bytes at a time, every channel on its own, which is what
+// the pairs of the scalar version come down to. "a" and "b" hold a weight per byte.
+static inline uint8x8_t interpolateBytes256Neon(const uint8x8_t x, const uint16x8_t a, const uint8x8_t y, const uint16x8_t b)
+{
+    // At most 255 * 256, it fits.
+    const uint16x8_t sum = vmlaq_u16(vmulq_u16(vmovl_u8(x), a), vmovl_u8(y), b);
+    return vshrn_n_u16(sum, 8);
+}
+
+static void interpolateRowsNeon(const uchar *row0, const uchar *row1, const int weight, uchar *dest, const int count)
+{
+    if (weight == 0) {
+        std::memcpy(dest, row0, size_t(count) * 4);
+        return;
+    }
+    const uint16x8_t a = vdupq_n_u16(uint16_t(256 - weight));
+    const uint16x8_t b = vdupq_n_u16(uint16_t(weight));
+    int x = 0;
+    for (; (x + 4) <= count; x += 4) {
+        const uint8x16_t p0 = vld1q_u8(row0 + x * 4);
+        const uint8x16_t p1 = vld1q_u8(row1 + x * 4);
+        const uint8x8_t low = interpolateBytes256Neon(vget_low_u8(p0), a, vget_low_u8(p1), b);
+        const uint8x8_t high = interpolateBytes256Neon(vget_high_u8(p0), a, vget_high_u8(p1), b);
+        vst1q_u8(dest + x * 4, vcombine_u8(low, high));
+    }
+    interpolateRowsScalar(row0, row1, weight, dest, x, count);
+}
+
+static void interpolateColumnsNeon(const uchar *src, const int *offsets, const quint16 *weights, uchar *dest, const int count)
+{
+    int x = 0;
+    for (; (x + 2) <= count; x += 2) {
+        // The two neighbours of both destination pixels, then the left and the right ones apart.
+        const uint32x2x2_t pairs = vtrn_u32(vreinterpret_u32_u8(vld1_u8(src + offsets[x] * 4)),
+                                            vreinterpret_u32_u8(vld1_u8(src + offsets[x + 1] * 4)));
+        const uint16x8_t b = vcombine_u16(vdup_n_u16(weights[x]), vdup_n_u16(weights[x + 1]));
+        const uint16x8_t a = vsubq_u16(vdupq_n_u16(256), b);
+        vst1_u8(dest + x * 4, interpolateBytes256Neon(vreinterpret_u8_u32(pairs.val[0]), a, vreinterpret_u8_u32(pairs.val[1]), b));
+    }
+    interpolateColumnsScalar(src, offsets, weights, dest, x, count);
+}
+
+#endif // FLH_BLUR_NEON
+
+static inline const BlurKernels::KernelTable &selectKernels()
+{
+    if (Utilities::forceScalarBlur()) {
+        return BlurKernels::scalarKernels();
+    }
+#ifdef FLH_BLUR_SSE2
+    if (cpuHasAvx2()) {
+        static const BlurKernels::KernelTable avx2 = {"AVX2", blurArgb32Avx2, blurAlpha8Avx2, downsampleSse2, upsampleSse2, extractAlphaSse2, sourceOverSse2,
+                                                       interpolateRowsSse2, interpolateColumnsSse2};
+        return avx2;
+    }
+    static const BlurKernels::KernelTable sse2 = {"SSE2", blurArgb32Sse2, blurAlpha8Sse2, downsampleSse2, upsampleSse2, extractAlphaSse2, sourceOverSse2,
+                                                   interpolateRowsSse2, interpolateColumnsSse2};
+    return sse2;
+#elif defined(FLH_BLUR_NEON)
+    static const BlurKernels::KernelTable neon = {"NEON", blurArgb32Neon, blurAlpha8Neon, downsampleNeon, upsampleNeon, extractAlphaNeon, sourceOverNeon,
+                                                   interpolateRowsNeon, interpolateColumnsNeon};
+    return neon;
+#else
+    return BlurKernels::scalarKernels();
+#endif
+}
+
+const BlurKernels::KernelTable &BlurKernels::kernels()
+{
+    static const KernelTable &table = selectKernels();
+    return table;
+}
+
+const BlurKernels::KernelTable &BlurKernels::scalarKernels()
+{
+    static const KernelTable table = {"Scalar", blurLinesScalar<false>, blurLinesScalar<true>, downsampleScalar, upsampleScalar, extractAlphaScalar, sourceOverScalar,
+                                      interpolateRowsScalar, interpolateColumnsScalar};
+    return table;
+}
+
+static inline void loadLine(const uchar *line, const int length, const qsizetype step, const int channels, float *values)
+{
+    for (int index = 0; index < length; ++index, line += step, values += channels) {
+        for (int channel = 0; channel < channels; ++channel) {
+            values[channel] = line[channel];
+        }
+    }
+}
+
+static inline void storeLine(uchar *line, const int length, const qsizetype step, const int channels, const float *values)
+{
+    for (int index = 0; index < length; ++index, line += step, values += channels) {
+        for (int channel = 0; channel < channels; ++channel) {
+            line[channel] = uchar(qBound(0, int(values[channel] + 0.5f), 255));
+        }
+    }
+}
+
+void BlurKernels::boxBlurLine(uchar *line, const int length, const qsizetype step, const int channels, const int radius, const int passes, float *scratch)
+{
+    if ((length <= 1) || (radius <= 0) || (passes <= 0)) {
+        return;
+    }
+    float *src = scratch;
+    float *dst = scratch + (qsizetype(length) * channels);
+    loadLine(line, length, step, channels, src);
+    const int last = length - 1;
+    const float scale = 1.0f / float(2 * radius + 1);
+    for (int pass = 0; pass != passes; ++pass) {
+        for (int channel = 0; channel < channels; ++channel) {
+            const auto at = [src, channels, channel](const int index) -> float {
+                return src[index * channels + channel];
+            };
+            // The window of the first element, everything left of it is the first element.
+            float sum = at(0) * float(radius + 1);
+            const int inside = qMin(radius, last);
+            for (int index = 1; index <= inside; ++index) {
+                sum += at(index);
+            }
+            sum += at(last) * float(radius - inside);
+            for (int index = 0; index < length; ++index) {
+                // Keep the intermediate passes integral, like the 8-bit image they stand for.
+                dst[index * channels + channel] = float(int(sum * scale + 0.5f));
+                sum += at(qMin(index + radius + 1, last)) - at(qMax(index - radius, 0));
+            }
+        }
+        std::swap(src, dst);
+    }
+    storeLine(line, length, step, channels, src);
+}
+
+void BlurKernels::stackBlurLine(uchar *line, const int length, const qsizetype step, const int channels, const int radius, float *scratch)
+{
+    if ((length <= 1) || (radius <= 0)) {
+        return;
+    }
+    float *src = scratch;
+    float *dst = scratch + (qsizetype(length) * channels);
+    loadLine(line, length, step, channels, src);
+    const int last = length - 1;
+    // The weights are radius + 1 - |k| for k in [-radius, radius].
+    const double scale = 1.0 / (double(radius + 1) * double(radius + 1));
+    for (int channel = 0; channel < channels; ++channel) {
+        const auto at = [src, channels, channel](const int index) -> double {
+            return src[index * channels + channel];
+        };
+        // "sumOut" holds the left half of the window including its center, "sumIn" the right half.
+        double sumOut = at(0) * double(radius + 1);
+        double sum = at(0) * double(radius + 1) * double(radius + 2) / 2;
+        double sumIn = 0;
+        const int inside = qMin(radius, last);
+        for (int k = 1; k <= inside; ++k) {
+            sumIn += at(k);
+            sum += at(k) * double(radius + 1 - k);
+        }
+        const double outside = radius - inside;
+        sumIn += at(last) * outside;
+        sum += at(last) * outside * (outside + 1) / 2;
+        for (int index = 0; index < length; ++index) {
+            dst[index * channels + channel] = float(sum * scale);
+            sum -= sumOut;
+            sumOut -= at(qMax(index - radius, 0));
+            sumIn += at(qMin(index + radius + 1, last));
+            sum += sumIn;
+            const double center = at(qMin(index + 1, last));
+            sumOut += center;
+            sumIn -= center;
+        }
+    }
+    storeLine(line, length, step, channels, dst);
+}
+
+BlurKernels::GaussianCoefficients BlurKernels::gaussianCoefficients(const qreal sigma)
+{
+    if (sigma < 0.5) {
+        return {};
+    }
+    const qreal q = (sigma >= 2.5) ? (0.98711 * sigma - 0.96330) : (3.97156 - 4.14554 * qSqrt(1 - 0.26891 * sigma));
+    const qreal q2 = q * q;
+    const qreal q3 = q2 * q;
+    const qreal b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+    const qreal b1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+    const qreal b2 = -(1.4281 * q2 + 1.26661 * q3);
+    const qreal b3 = 0.422205 * q3;
+    GaussianCoefficients coefficients = {};
+    coefficients.b1 = float(b1 / b0);
+    coefficients.b2 = float(b2 / b0);
+    coefficients.b3 = float(b3 / b0);
+    coefficients.b = 1.0f - (coefficients.b1 + coefficients.b2 + coefficients.b3);
+    return coefficients;
+}
+
+void BlurKernels::gaussianBlurLine(uchar *line, const int length, const qsizetype step, const int channels, const GaussianCoefficients &coefficients, float *scratch)
+{
+    if ((length <= 1) || (coefficients.b >= 1.0f)) {
+        return;
+    }
+    float *values = scratch;
+    loadLine(line, length, step, channels, values);
+    const float b = coefficients.b;
+    const float b1 = coefficients.b1;
+    const float b2 = coefficients.b2;
+    const float b3 = coefficients.b3;
+    for (int channel = 0; channel < channels; ++channel) {
+        float *v = values + channel;
+        // A constant signal is a fixed point of both recursions, start from the edges' steady state.
+        float w1 = v[0], w2 = v[0], w3 = v[0];
+        for (int index = 0; index < length; ++index) {
+            const float w = b * v[index * channels] + b1 * w1 + b2 * w2 + b3 * w3;
+            v[index * channels] = w;
+            w3 = w2;
+            w2 = w1;
+            w1 = w;
+        }
+        const float edge = v[(length - 1) * channels];
+        w1 = edge, w2 = edge, w3 = edge;
+        for (int index = length - 1; index >= 0; --index) {
+            const float w = b * v[index * channels] + b1 * w1 + b2 * w2 + b3 * w3;
+            v[index * channels] = w;
+            w3 = w2;
+            w2 = w1;
+            w1 = w;
+        }
+    }
+    storeLine(line, length, step, channels, values);
+}
+
+// Both directions visit the source in square tiles which fit into a few cache lines, so
+// neither the reads nor the scattered writes of a tile leave the L1 cache.
+// Three bytes without any padding or alignment, so that RGB888 pixels can be moved around
+// as a whole.
+struct Pixel24
+{
+    uchar values[3];
+};
+static_assert(sizeof(Pixel24) == 3, "RGB888 pixels have to be packed.");
+
+template<typename T, const bool clockwise>
+static inline void rotateTiled(const uchar *src, const int width, const int height, const qsizetype srcBytesPerLine,
+                               uchar *dest, const qsizetype destBytesPerLine)
+{
+    constexpr int tileSize = 64 / int(sizeof(T));
+    for (int tileY = 0; tileY < height; tileY += tileSize) {
+        const int stopY = qMin(tileY + tileSize, height);
+        for (int tileX = 0; tileX < width; tileX += tileSize) {
+            const int stopX = qMin(tileX + tileSize, width);
+            for (int x = tileX; x < stopX; ++x) {
+                // qt_memrotate270(): source column "x" becomes destination row "x", bottom to top.
+                // qt_memrotate90(): source column "x" becomes destination row "width - x - 1", top to bottom.
+                T *d = reinterpret_cast<T *>(dest + (clockwise ? x : (width - x - 1)) * destBytesPerLine);
+                const uchar *s = src + tileY * srcBytesPerLine + x * qsizetype(sizeof(T));
+                for (int y = tileY; y < stopY; ++y, s += srcBytesPerLine) {
+                    d[clockwise ? (height - y - 1) : y] = *reinterpret_cast<const T *>(s);
+                }
+            }
+        }
+    }
+}
+
+void BlurKernels::rotate90(const uchar *src, const int width, const int height, const qsizetype srcBytesPerLine,
+                           uchar *dest, const qsizetype destBytesPerLine, const int depth)
+{
+    Q_ASSERT((depth == 8) || (depth == 24) || (depth == 32));
+    if (depth == 8) {
+        rotateTiled<quint8, false>(src, width, height, srcBytesPerLine, dest, destBytesPerLine);
+    } else if (depth == 24) {
+        rotateTiled<Pixel24, false>(src, width, height, srcBytesPerLine, dest, destBytesPerLine);
+    } else {
+        rotateTiled<quint32, false>(src, width, height, srcBytesPerLine, dest, destBytesPerLine);
+    }
+}
+
+void BlurKernels::rotate270(const uchar *src, const int width, const int height, const qsizetype srcBytesPerLine,
+                            uchar *dest, const qsizetype destBytesPerLine, const int depth)
+{
+    Q_ASSERT((depth == 8) || (depth == 24) || (depth == 32));
+    if (depth == 8) {
+        rotateTiled<quint8, true>(src, width, height, srcBytesPerLine, dest, destBytesPerLine);
+    } else if (depth == 24) {
+        rotateTiled<Pixel24, true>(src, width, height, srcBytesPerLine, dest, destBytesPerLine);
+    } else {
+        rotateTiled<quint32, true>(src, width, height, srcBytesPerLine, dest, destBytesPerLine);
+    }
+}
+
+namespace {
+
+struct ParallelForState
+{
+    void *context = nullptr;
+    BlurKernels::ChunkFunction function = nullptr;
+    int count = 0;
+    int grain = 0;
+    int chunks = 0;
+    std::atomic_int nextChunk = 0;
+    std::atomic_int nextWorker = 0;
+    QSemaphore finishedChunks;
+
+    void run()
+    {
+        const int worker = nextWorker.fetch_add(1, std::memory_order_relaxed);
+        for (;;) {
+            const int chunk = nextChunk.fetch_add(1, std::memory_order_relaxed);
+            if (chunk >= chunks) {
+                return;
+            }
+            const int begin = chunk * grain;
+            function(context, begin, qMin(begin + grain, count), worker);
+            finishedChunks.release();
+        }
+    }
+};
+
+class ParallelForTask : public QRunnable
+{
+public:
+    explicit ParallelForTask(const std::shared_ptr<ParallelForState> &state) : m_state(state) {}
+    ~ParallelForTask() override = default;
+
+    void run() override
+    {
+        m_state->run();
+    }
+
+private:
+    // Shared because a helper may only get started after the caller has returned,
+    // it will then find no chunk left and exit right away.
+    std::shared_ptr<ParallelForState> m_state = nullptr;
+};
+
+}
+
+void BlurKernels::parallelFor(const int count, const int grain, const int threadCount, void *context, const ChunkFunction function)
+{
+    Q_ASSERT(grain > 0);
+    if ((count <= 0) || (grain <= 0) || !function) {
+        return;
+    }
+    const int chunks = (count + grain - 1) / grain;
+    const int helpers = qMin(threadCount, chunks) - 1;
+    if (helpers <= 0) {
+        function(context, 0, count, 0);
+        return;
+    }
+    const auto state = std::make_shared<ParallelForState>();
+    state->context = context;
+    state->function = function;
+    state->count = count;
+    state->grain = grain;
+    state->chunks = chunks;
+    QThreadPool *pool = QThreadPool::globalInstance();
+    for (int helper = 0; helper != helpers; ++helper) {
+        pool->start(new ParallelForTask(state));
+    }
+    state->run();
+    state->finishedChunks.acquire(chunks);
+}
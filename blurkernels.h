@@ -0,0 +1,161 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2021 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "framelesshelper_global.h"
+#include <type_traits>
+
+/*
+ * Low level building blocks of Utilities::blurImage(). Nothing in here is exported,
+ * the functions operate on raw memory and know nothing about QImage.
+ */
+
+namespace BlurKernels {
+
+// Precision of the alpha parameter (fixed-point format 0.aprec) and of the
+// filter state (fixed-point format 8.zprec) of the exponential blur.
+constexpr int AlphaPrecision = 12;
+constexpr int StatePrecision = 10;
+
+// Blurs "count" independent lines in place with the two sided exponential impulse
+// response of expblur(). Line "i" starts at "lines[i]" and has "length" elements
+// which are "step" bytes apart ("step" can be negative). Each line is walked forward
+// once and then backward once, the state of the filter is carried over between the
+// two directions, exactly like Qt's qt_blurrow() does.
+using LineKernel = void (*)(uchar * const *lines, const int count, const int length, const qsizetype step, const int alpha);
+
+// Resampling kernels used by the downsample pyramid. Pixels have "channels" interleaved
+// 8-bit values: 4 for the 32-bit formats, 3 for RGB888, 1 for Grayscale8 and Alpha8.
+//
+// Downsampling averages 2x2 blocks, destination row "y" is made from the source rows
+// "2y" and "2y + 1". "width" and "height" are the size of the destination. 32-bit and
+// 24-bit pixels are averaged like the AVG() macro of qt_halfScaled() does, 8-bit ones
+// are rounded.
+using DownsampleKernel = void (*)(const uchar *src, const qsizetype srcBytesPerLine, uchar *dest, const qsizetype destBytesPerLine,
+                                  const int width, const int height, const int channels);
+// Bilinear 1:2 upsampling of a "width" x "height" source, the pixel centers are kept
+// where QPainter's SmoothPixmapTransform puts them and the edges are clamped. Only the
+// source rows [begin, end) are processed, they become the destination rows [2 * begin,
+// 2 * end), so bands of an image can be upsampled independently. "scratch" needs room
+// for upsampleScratchSize() values.
+using UpsampleKernel = void (*)(const uchar *src, const int width, const int height, const qsizetype srcBytesPerLine,
+                                uchar *dest, const qsizetype destBytesPerLine, const int channels, const int begin, const int end,
+                                quint16 *scratch);
+
+constexpr qsizetype upsampleScratchSize(const int width, const int channels)
+{
+    return 2 * (qsizetype(width) + 2) * qsizetype(channels);
+}
+
+// Copies the alpha channel of "width" x "height" 32-bit pixels into a packed plane of
+// 8-bit values, so that alpha-only work doesn't have to walk the color channels too.
+// "alphaOffset" is the byte of a pixel which holds its alpha value.
+using ExtractAlphaKernel = void (*)(const uchar *src, const qsizetype srcBytesPerLine, uchar *dest, const qsizetype destBytesPerLine,
+                                    const int width, const int height, const int alphaOffset);
+
+// Draws "count" premultiplied 32-bit pixels of "src" over the ones of "dest" like
+// QPainter::CompositionMode_SourceOver does, with the rounding of Qt's BYTE_MUL().
+// "opacity" (0 to 255) scales "src" first, like the one of QPainter::setOpacity().
+using SourceOverKernel = void (*)(uchar *dest, const uchar *src, const int count, const int opacity);
+
+// The two halves of a bilinear resampling of 32-bit pixels, with weights from 0 to 256 like
+// the ones of Qt's INTERPOLATE_PIXEL_256(). The rows one mixes "count" pixels of two rows,
+// "weight" is the one of "row1". The columns one makes "dest[x]" from the pixels
+// "offsets[x]" and "offsets[x] + 1" of "src", "weights[x]" is the one of the second.
+using InterpolateRowsKernel = void (*)(const uchar *row0, const uchar *row1, const int weight, uchar *dest, const int count);
+using InterpolateColumnsKernel = void (*)(const uchar *src, const int *offsets, const quint16 *weights, uchar *dest, const int count);
+
+struct KernelTable
+{
+    const char *name = nullptr;
+    LineKernel argb32 = nullptr; // 32-bit pixels, all four channels are blurred.
+    LineKernel alpha8 = nullptr; // One 8-bit channel per element, also used for every channel of RGB888.
+    DownsampleKernel downsample = nullptr;
+    UpsampleKernel upsample = nullptr;
+    ExtractAlphaKernel extractAlpha = nullptr;
+    SourceOverKernel sourceOver = nullptr;
+    InterpolateRowsKernel interpolateRows = nullptr;
+    InterpolateColumnsKernel interpolateColumns = nullptr;
+};
+
+// The best kernels the current CPU supports. Set the "_FRAMELESSHELPER_FORCE_SCALAR_BLUR"
+// environment variable to always get the scalar ones.
+const KernelTable &kernels();
+const KernelTable &scalarKernels();
+
+// Constant time per element approximations of a Gaussian blur, see Utilities::BlurAlgorithm.
+// Like above, a line has "length" elements which are "step" bytes apart. Every element has
+// "channels" interleaved 8-bit values: 4 for 32-bit pixels, 3 for RGB888, 1 for a single channel. The
+// line is extended by repeating its first and last element. "scratch" needs room for
+// lineScratchSize() values.
+constexpr qsizetype lineScratchSize(const int length, const int channels)
+{
+    return 2 * qsizetype(length) * qsizetype(channels);
+}
+
+void boxBlurLine(uchar *line, const int length, const qsizetype step, const int channels, const int radius, const int passes, float *scratch);
+void stackBlurLine(uchar *line, const int length, const qsizetype step, const int channels, const int radius, float *scratch);
+
+// Young and van Vliet, "Recursive implementation of the Gaussian filter", 1995.
+// The coefficients are already divided by b0.
+struct GaussianCoefficients
+{
+    float b = 1;
+    float b1 = 0;
+    float b2 = 0;
+    float b3 = 0;
+};
+
+GaussianCoefficients gaussianCoefficients(const qreal sigma);
+void gaussianBlurLine(uchar *line, const int length, const qsizetype step, const int channels, const GaussianCoefficients &coefficients, float *scratch);
+
+// Tiled replacements of Qt's private qt_memrotate90() and qt_memrotate270() for 8-bit,
+// 24-bit and 32-bit pixels. The destination is "height" pixels wide and "width" pixels high.
+void rotate90(const uchar *src, const int width, const int height, const qsizetype srcBytesPerLine,
+              uchar *dest, const qsizetype destBytesPerLine, const int depth);
+void rotate270(const uchar *src, const int width, const int height, const qsizetype srcBytesPerLine,
+               uchar *dest, const qsizetype destBytesPerLine, const int depth);
+
+// Calls "function(begin, end, worker)" for consecutive chunks of at most "grain" items
+// until [0, count) is covered. Up to "threadCount" threads work on the chunks: the calling
+// thread and helpers from the global QThreadPool. Returns when all chunks are done.
+// The calling thread keeps taking chunks itself, so it never waits for a helper that
+// could not be started because the pool is busy. "worker" is smaller than "threadCount"
+// and unique among the threads which are running at the same time, it can be used to
+// pick a scratch buffer.
+using ChunkFunction = void (*)(void *context, const int begin, const int end, const int worker);
+
+void parallelFor(const int count, const int grain, const int threadCount, void *context, const ChunkFunction function);
+
+template<typename Function>
+inline void parallelFor(const int count, const int grain, const int threadCount, Function &&function)
+{
+    // Type erased by hand, a std::function would have to allocate for most lambdas.
+    parallelFor(count, grain, threadCount, &function, [](void *context, const int begin, const int end, const int worker) {
+        (*static_cast<std::remove_reference_t<Function> *>(context))(begin, end, worker);
+    });
+}
+
+}
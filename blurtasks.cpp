@@ -0,0 +1,122 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2021 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "utilities.h"
+#include "blurengine.h"
+#include <QtCore/qfutureinterface.h>
+#include <QtCore/qthreadpool.h>
+#include <QtCore/qrunnable.h>
+#include <QtCore/qthread.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qhash.h>
+
+/*
+ * The background half of Utilities::blurImageAsync(). Jobs run on their own thread pool,
+ * so that they never hold up the users of the global one, with a low thread priority and
+ * on a single thread each: they are there to keep the GUI thread free, not to race it.
+ */
+
+namespace {
+
+struct BlurTaskData
+{
+    QThreadPool pool;
+    QMutex mutex;
+    // The newest unfinished job of every owner.
+    QHash<const void *, QFutureInterface<QImage>> latestJobs = {};
+
+    explicit BlurTaskData()
+    {
+        pool.setMaxThreadCount(qMax(QThread::idealThreadCount() / 2, 1));
+    }
+};
+
+}
+
+Q_GLOBAL_STATIC(BlurTaskData, blurTaskData)
+
+namespace {
+
+class BlurTask : public QRunnable
+{
+public:
+    explicit BlurTask(const QFutureInterface<QImage> &job, const void *owner, const QImage &image, const qreal radius,
+                      const bool quality, const bool alphaOnly, const Utilities::BlurAlgorithm algorithm)
+        : m_job(job), m_owner(owner), m_image(image), m_radius(radius), m_quality(quality), m_alphaOnly(alphaOnly), m_algorithm(algorithm) {}
+    ~BlurTask() override = default;
+
+    void run() override
+    {
+        // A job that was cancelled or superseded while it was waiting is just dropped.
+        if (!m_job.isCanceled()) {
+            QThread::currentThread()->setPriority(QThread::LowPriority);
+            // Every thread of the pool keeps its engine, and with it the pyramid of its last job.
+            // The result itself is taken out of it, it's the caller's from now on.
+            static thread_local BlurEngine engine;
+            engine.setAlgorithm(m_algorithm);
+            engine.setImprovedQuality(m_quality);
+            engine.setThreadCount(1);
+            engine.blur(nullptr, m_image, m_radius, m_alphaOnly);
+            if (!m_job.isCanceled()) {
+                m_job.reportResult(engine.takeResult());
+            }
+        }
+        m_job.reportFinished();
+        if (m_owner) {
+            QMutexLocker locker(&blurTaskData()->mutex);
+            const auto it = blurTaskData()->latestJobs.constFind(m_owner);
+            if ((it != blurTaskData()->latestJobs.constEnd()) && (it.value() == m_job)) {
+                blurTaskData()->latestJobs.erase(it);
+            }
+        }
+    }
+
+private:
+    QFutureInterface<QImage> m_job = {};
+    const void *m_owner = nullptr;
+    QImage m_image = {};
+    qreal m_radius = 0.0;
+    bool m_quality = false;
+    bool m_alphaOnly = false;
+    Utilities::BlurAlgorithm m_algorithm = Utilities::BlurAlgorithm::Exponential;
+};
+
+}
+
+QFuture<QImage> Utilities::blurImageAsync(const QImage &image, const qreal radius, const bool quality, const bool alphaOnly,
+                                          const BlurAlgorithm algorithm, const void *owner)
+{
+    QFutureInterface<QImage> job = {};
+    job.reportStarted();
+    const QFuture<QImage> future = job.future();
+    if (owner) {
+        QMutexLocker locker(&blurTaskData()->mutex);
+        auto &latest = blurTaskData()->latestJobs[owner];
+        // Nobody is going to look at the older result anymore.
+        latest.cancel();
+        latest = job;
+    }
+    blurTaskData()->pool.start(new BlurTask(job, owner, image, radius, quality, alphaOnly, algorithm));
+    return future;
+}
@@ -3,3 +3,14 @@ CONFIG -= ordered
 SUBDIRS += lib examples
 lib.file = lib.pro
 examples.depends += lib
+# Opt-in, run qmake with "CONFIG+=build_benchmarks".
+build_benchmarks {
+    qtHaveModule(testlib) {
+        SUBDIRS += benchmarks
+        benchmarks.depends += lib
+    }
+    SUBDIRS += accuracy
+    accuracy.file = benchmarks/accuracy.pro
+    accuracy.makefile = Makefile.accuracy
+    accuracy.depends += lib
+}
@@ -2,7 +2,7 @@ TARGET = $$qtLibraryTarget(FramelessHelper)
 TEMPLATE = lib
 win32: DLLDESTDIR = $$OUT_PWD/bin
 else: unix: DESTDIR = $$OUT_PWD/bin
-QT += gui-private
+QT += gui
 CONFIG += c++17 strict_c++ utf8_source warn_on
 DEFINES += \
     QT_NO_CAST_FROM_ASCII \
@@ -16,11 +16,22 @@ HEADERS += \
     framelesshelper.h \
     framelesswindowsmanager.h \
     utilities.h \
+    blurkernels.h \
+    blurengine.h \
+    blurcache.h \
+    wallpapercache.h \
+    wallpaperstore.h \
     qtacryliceffecthelper.h
 SOURCES += \
     framelesshelper.cpp \
     framelesswindowsmanager.cpp \
     utilities.cpp \
+    blurkernels.cpp \
+    blurengine.cpp \
+    blurtasks.cpp \
+    blurcache.cpp \
+    wallpapercache.cpp \
+    wallpaperstore.cpp \
     qtacryliceffecthelper.cpp
 qtHaveModule(widgets) {
     QT += widgets
@@ -40,6 +51,7 @@ qtHaveModule(quick) {
 }
 RESOURCES += qtacrylichelper.qrc
 win32 {
+    QT += gui-private
     DEFINES += \
         WIN32_LEAN_AND_MEAN \
         _CRT_SECURE_NO_WARNINGS \
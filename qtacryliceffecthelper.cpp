@@ -24,10 +24,33 @@
 
 #include "qtacryliceffecthelper.h"
 #include "utilities.h"
+#include "wallpaperstore.h"
+#include "blurkernels.h"
 #include <QtGui/qpainter.h>
 #include <QtCore/qdebug.h>
 #include <QtGui/qwindow.h>
 #include <QtCore/qcoreapplication.h>
+#include <QtCore/qmath.h>
+#include <cstring>
+
+static const QImage &getNoiseTexture()
+{
+    static const QImage noiseTexture(QStringLiteral(":/QtAcrylicHelper/Noise.png"));
+    return noiseTexture;
+}
+
+static QColor getFillColor()
+{
+#ifdef Q_OS_WINDOWS
+    if (!Utilities::isOfficialMSWin10AcrylicBlurAvailable()) {
+        // Add a soft light layer for the background.
+        QColor fillColor = Qt::white;
+        fillColor.setAlpha(150);
+        return fillColor;
+    }
+#endif
+    return Qt::transparent;
+}
 
 QtAcrylicEffectHelper::QtAcrylicEffectHelper(QObject *parent) : QObject(parent)
 {
@@ -43,9 +66,28 @@ QtAcrylicEffectHelper::QtAcrylicEffectHelper(QObject *parent) : QObject(parent)
 #else
     m_frameColor = Qt::black;
 #endif
+    connect(&m_wallpaperWatcher, &QFutureWatcher<QImage>::finished, this, [this](){
+        const QFuture<QImage> future = m_wallpaperWatcher.future();
+        if (!m_wallpaperAcquired || future.isCanceled() || (future.resultCount() < 1)) {
+            return;
+        }
+        const QImage result = future.result();
+        // Taken over right away if it was ready already.
+        if (result.cacheKey() == m_bluredWallpaper.cacheKey()) {
+            return;
+        }
+        m_bluredWallpaper = result;
+        Q_EMIT needsRepaint();
+    });
+    if (WallpaperWatcher *watcher = WallpaperWatcher::instance()) {
+        connect(watcher, &WallpaperWatcher::backdropChanged, this, &QtAcrylicEffectHelper::handleBackdropChange);
+    }
 }
 
-QtAcrylicEffectHelper::~QtAcrylicEffectHelper() = default;
+QtAcrylicEffectHelper::~QtAcrylicEffectHelper()
+{
+    releaseWallpaper(false);
+}
 
 void QtAcrylicEffectHelper::install(const QWindow *window)
 {
@@ -61,10 +103,12 @@ void QtAcrylicEffectHelper::install(const QWindow *window)
         // What's the difference between "visibility" and "window state"?
         //connect(m_window, &QWindow::visibilityChanged, this, &QtAcrylicEffectHelper::needsRepaint);
         connect(m_window, &QWindow::windowStateChanged, this, &QtAcrylicEffectHelper::needsRepaint);
+        connect(m_window, &QWindow::screenChanged, this, &QtAcrylicEffectHelper::handleScreenChange);
 #ifdef Q_OS_WINDOWS
         //QtAcrylicWinEventFilter::setup();
 #endif
     }
+    prewarm();
 }
 
 void QtAcrylicEffectHelper::uninstall()
@@ -78,15 +122,32 @@ void QtAcrylicEffectHelper::uninstall()
         disconnect(m_window, &QWindow::activeChanged, this, &QtAcrylicEffectHelper::needsRepaint);
         //disconnect(m_window, &QWindow::visibilityChanged, this, &QtAcrylicEffectHelper::needsRepaint);
         disconnect(m_window, &QWindow::windowStateChanged, this, &QtAcrylicEffectHelper::needsRepaint);
+        disconnect(m_window, &QWindow::screenChanged, this, &QtAcrylicEffectHelper::handleScreenChange);
         m_window = nullptr;
     }
+    releaseWallpaper(false);
 }
 
 void QtAcrylicEffectHelper::clearWallpaper()
 {
-    if (!m_bluredWallpaper.isNull()) {
-        m_bluredWallpaper = {};
+    // The wallpaper has changed. The watcher tells all the helpers to make their backdrops
+    // again, otherwise the next paint of this one does it.
+    if (WallpaperWatcher *watcher = WallpaperWatcher::instance()) {
+        watcher->refresh();
+    } else {
+        releaseWallpaper(true);
+    }
+}
+
+void QtAcrylicEffectHelper::prewarm()
+{
+    if (!checkWindow()) {
+        return;
     }
+    if (Utilities::disableExtraProcessingForBlur() || Utilities::shouldUseTraditionalBlur()) {
+        return;
+    }
+    updateBehindWindowBackground();
 }
 
 void QtAcrylicEffectHelper::showWarning() const
@@ -96,6 +157,18 @@ void QtAcrylicEffectHelper::showWarning() const
 
 QBrush QtAcrylicEffectHelper::getAcrylicBrush() const
 {
+    if (m_acrylicBrushDirty) {
+        QImage acrylicTexture({64, 64}, QImage::Format_ARGB32_Premultiplied);
+        acrylicTexture.fill(getFillColor());
+        QPainter painter(&acrylicTexture);
+        painter.setOpacity(m_tintOpacity);
+        painter.fillRect(QRect{0, 0, acrylicTexture.width(), acrylicTexture.height()}, getAppropriateTintColor());
+        painter.setOpacity(m_noiseOpacity);
+        painter.fillRect(QRect{0, 0, acrylicTexture.width(), acrylicTexture.height()}, getNoiseTexture());
+        painter.end();
+        m_acrylicBrush = acrylicTexture;
+        m_acrylicBrushDirty = false;
+    }
     return m_acrylicBrush;
 }
 
@@ -116,7 +189,7 @@ qreal QtAcrylicEffectHelper::getNoiseOpacity() const
 
 QPixmap QtAcrylicEffectHelper::getBluredWallpaper() const
 {
-    return m_bluredWallpaper;
+    return QPixmap::fromImage(m_bluredWallpaper);
 }
 
 QColor QtAcrylicEffectHelper::getFrameColor() const
@@ -137,6 +210,7 @@ void QtAcrylicEffectHelper::setTintColor(const QColor &value)
     }
     if (m_tintColor != value) {
         m_tintColor = value;
+        m_acrylicBrushDirty = true;
     }
 }
 
@@ -144,6 +218,7 @@ void QtAcrylicEffectHelper::setTintOpacity(const qreal value)
 {
     if (m_tintOpacity != value) {
         m_tintOpacity = value;
+        m_acrylicBrushDirty = true;
     }
 }
 
@@ -151,6 +226,7 @@ void QtAcrylicEffectHelper::setNoiseOpacity(const qreal value)
 {
     if (m_noiseOpacity != value) {
         m_noiseOpacity = value;
+        m_acrylicBrushDirty = true;
     }
 }
 
@@ -227,11 +303,138 @@ void QtAcrylicEffectHelper::paintBackground(QPainter *painter, const QRect &rect
     } else {
         // Emulate blur behind window by blurring the desktop wallpaper.
         updateBehindWindowBackground();
-        painter->drawPixmap(QPoint{0, 0}, m_bluredWallpaper, QRect{m_window->mapToGlobal(QPoint{0, 0}), rect.size()});
+        if (scaleBackdrop(rect.size())) {
+            const QRgb tint = getTintLayer();
+            const int noiseOpacity = qRound(qBound(qreal(0), m_noiseOpacity, qreal(1)) * 255);
+            const QRectF target = {QPointF{0, 0}, QSizeF(rect.size())};
+            const QRectF source = {QPointF{0, 0}, QSizeF(rect.size()) * m_scaledBackdrop.devicePixelRatio()};
+            const bool composed = m_compositionValid && (m_compositionTint == tint) && (m_compositionNoiseOpacity == noiseOpacity);
+            // While the tint or the noise is animated they change from one paint to the next,
+            // making the composition again every time would cost a pass over every pixel of
+            // the window per frame. They are drawn on top of the backdrop instead until they
+            // stay the same for two paints in a row (or the backdrop has to be composed anyway).
+            const bool settled = (m_paintedTint == tint) && (m_paintedNoiseOpacity == noiseOpacity);
+            if (composed || settled || !m_compositionValid) {
+                if (!composed) {
+                    composeBackdrop(tint, noiseOpacity);
+                }
+                painter->drawImage(target, m_composition, source);
+            } else {
+                const QPainter::CompositionMode mode = painter->compositionMode();
+                const qreal opacity = painter->opacity();
+                painter->drawImage(target, m_scaledBackdrop, source);
+                painter->setCompositionMode(QPainter::CompositionMode_SourceOver);
+                painter->fillRect(target, QColor::fromRgba(qUnpremultiply(tint)));
+                painter->setOpacity(opacity * noiseOpacity / 255);
+                painter->fillRect(target, QBrush(getNoiseTexture()));
+                painter->setOpacity(opacity);
+                painter->setCompositionMode(mode);
+            }
+            m_paintedTint = tint;
+            m_paintedNoiseOpacity = noiseOpacity;
+            return;
+        }
+        // Still being prepared, the tint alone stands in for it until needsRepaint() is emitted.
+        QColor placeholder = (m_tintColor.isValid() && (m_tintColor != Qt::transparent)) ? m_tintColor : QColor(Qt::white);
+        placeholder.setAlpha(255);
+        painter->fillRect(rect, placeholder);
     }
     painter->setCompositionMode(QPainter::CompositionMode_SourceOver);
     painter->setOpacity(1);
-    painter->fillRect(rect, m_acrylicBrush);
+    painter->fillRect(rect, getAcrylicBrush());
+}
+
+bool QtAcrylicEffectHelper::scaleBackdrop(const QSize &size)
+{
+    if ((m_bluredWallpaper.width() < 2) || (m_bluredWallpaper.height() < 2) || size.isEmpty()) {
+        return false;
+    }
+    if (m_bluredWallpaper.format() != QImage::Format_ARGB32_Premultiplied) {
+        return false;
+    }
+    const qreal dpr = m_wallpaperKey.devicePixelRatio;
+    const QSize deviceSize = {qCeil(size.width() * dpr), qCeil(size.height() * dpr)};
+    // The backdrop covers the screen of the window at a fraction of its resolution, only the
+    // part behind the window is scaled back up, bilinearly and clamped to the edges of it.
+    const qreal step = 1.0 / WallpaperStore::scaleFactor(m_wallpaperKey);
+    const QPointF origin = QPointF(m_window->mapToGlobal(QPoint{0, 0}) - m_wallpaperKey.screenGeometry.topLeft()) * (dpr * step);
+    if ((m_scaledBackdrop.size() == deviceSize) && (m_scaledBackdrop.devicePixelRatio() == dpr)
+            && (m_scaledBackdropOrigin == origin) && (m_scaledBackdropKey == m_bluredWallpaper.cacheKey())) {
+        return true;
+    }
+    if (m_scaledBackdrop.size() != deviceSize) {
+        m_scaledBackdrop = QImage(deviceSize, QImage::Format_ARGB32_Premultiplied);
+    }
+    m_scaledBackdrop.setDevicePixelRatio(dpr);
+    m_scaledBackdropOrigin = origin;
+    m_scaledBackdropKey = m_bluredWallpaper.cacheKey();
+    m_compositionValid = false;
+    const auto sample = [step](const qreal start, const int i, const int count, int *index, int *weight) {
+        const qreal position = qBound(qreal(0), start + (i + 0.5) * step - 0.5, qreal(count - 1));
+        *index = qMin(int(position), count - 2);
+        *weight = qRound((position - *index) * 256);
+    };
+    m_columnOffsets.resize(deviceSize.width());
+    m_columnWeights.resize(deviceSize.width());
+    for (int x = 0; x < deviceSize.width(); ++x) {
+        int weight = 0;
+        sample(origin.x(), x, m_bluredWallpaper.width(), &m_columnOffsets[x], &weight);
+        m_columnWeights[x] = static_cast<quint16>(weight);
+    }
+    const int firstColumn = m_columnOffsets.constFirst();
+    for (auto &&offset : m_columnOffsets) {
+        offset -= firstColumn;
+    }
+    m_rowBuffer.resize(m_columnOffsets.constLast() + 2);
+    uchar *rowBuffer = reinterpret_cast<uchar *>(m_rowBuffer.data());
+    const BlurKernels::KernelTable &kernels = BlurKernels::kernels();
+    for (int y = 0; y < deviceSize.height(); ++y) {
+        int row = 0, weight = 0;
+        sample(origin.y(), y, m_bluredWallpaper.height(), &row, &weight);
+        kernels.interpolateRows(m_bluredWallpaper.constScanLine(row) + firstColumn * 4, m_bluredWallpaper.constScanLine(row + 1) + firstColumn * 4,
+                                weight, rowBuffer, m_rowBuffer.size());
+        kernels.interpolateColumns(rowBuffer, m_columnOffsets.constData(), m_columnWeights.constData(), m_scaledBackdrop.scanLine(y),
+                                   deviceSize.width());
+    }
+    return true;
+}
+
+void QtAcrylicEffectHelper::composeBackdrop(const QRgb tint, const int noiseOpacity)
+{
+    const BlurKernels::KernelTable &kernels = BlurKernels::kernels();
+    const QSize deviceSize = m_scaledBackdrop.size();
+    const qreal dpr = m_scaledBackdrop.devicePixelRatio();
+    // Like the pattern of the acrylic brush, which is 64 device independent pixels wide.
+    const int tileSize = qMax(qRound(64 * dpr), 1);
+    if (m_noiseTile.width() != tileSize) {
+        m_noiseTile = QImage({tileSize, tileSize}, QImage::Format_ARGB32_Premultiplied);
+        m_noiseTile.fill(Qt::transparent);
+        QPainter painter(&m_noiseTile);
+        painter.drawImage(QRect{0, 0, tileSize, tileSize}, getNoiseTexture(), QRect{0, 0, 64, 64});
+    }
+    if (m_composition.size() != deviceSize) {
+        m_composition = QImage(deviceSize, QImage::Format_ARGB32_Premultiplied);
+    }
+    m_composition.setDevicePixelRatio(dpr);
+    m_compositionTint = tint;
+    m_compositionNoiseOpacity = noiseOpacity;
+    m_compositionValid = true;
+    m_tintRow.fill(tint, deviceSize.width());
+    for (int y = 0; y < deviceSize.height(); ++y) {
+        uchar *line = m_composition.scanLine(y);
+        std::memcpy(line, m_scaledBackdrop.constScanLine(y), size_t(deviceSize.width()) * 4);
+        if (qAlpha(tint) != 0) {
+            kernels.sourceOver(line, reinterpret_cast<const uchar *>(m_tintRow.constData()), deviceSize.width(), 255);
+        }
+        if (noiseOpacity == 0) {
+            continue;
+        }
+        // The noise starts at the origin of the window, like the pattern of the acrylic brush.
+        const uchar *noise = m_noiseTile.constScanLine(y % tileSize);
+        for (int x = 0; x < deviceSize.width(); x += tileSize) {
+            kernels.sourceOver(line + x * 4, noise, qMin(tileSize, deviceSize.width() - x), noiseOpacity);
+        }
+    }
 }
 
 void QtAcrylicEffectHelper::paintWindowFrame(QPainter *painter, const QRect &rect)
@@ -269,32 +472,31 @@ void QtAcrylicEffectHelper::paintWindowFrame(QPainter *painter, const QRect &rec
 
 void QtAcrylicEffectHelper::updateAcrylicBrush(const QColor &alternativeTintColor)
 {
-    const auto getAppropriateTintColor = [&alternativeTintColor, this]() -> QColor {
-        if (alternativeTintColor.isValid() && (alternativeTintColor != Qt::transparent)) {
-            return alternativeTintColor;
-        }
-        if (m_tintColor.isValid() && (m_tintColor != Qt::transparent)) {
-            return m_tintColor;
-        }
-        return Qt::white;
-    };
-    static const QImage noiseTexture(QStringLiteral(":/QtAcrylicHelper/Noise.png"));
-    QImage acrylicTexture({64, 64}, QImage::Format_ARGB32_Premultiplied);
-    QColor fillColor = Qt::transparent;
-#ifdef Q_OS_WINDOWS
-    if (!Utilities::isOfficialMSWin10AcrylicBlurAvailable()) {
-        // Add a soft light layer for the background.
-        fillColor = Qt::white;
-        fillColor.setAlpha(150);
+    // Nothing is made here, the brush is made again when it's needed and the wallpaper blur
+    // applies the tint and the noise while it paints.
+    m_alternativeTintColor = alternativeTintColor;
+    m_acrylicBrushDirty = true;
+}
+
+QColor QtAcrylicEffectHelper::getAppropriateTintColor() const
+{
+    if (m_alternativeTintColor.isValid() && (m_alternativeTintColor != Qt::transparent)) {
+        return m_alternativeTintColor;
     }
-#endif
-    acrylicTexture.fill(fillColor);
-    QPainter painter(&acrylicTexture);
-    painter.setOpacity(m_tintOpacity);
-    painter.fillRect(QRect{0, 0, acrylicTexture.width(), acrylicTexture.height()}, getAppropriateTintColor());
-    painter.setOpacity(m_noiseOpacity);
-    painter.fillRect(QRect{0, 0, acrylicTexture.width(), acrylicTexture.height()}, noiseTexture);
-    m_acrylicBrush = acrylicTexture;
+    if (m_tintColor.isValid() && (m_tintColor != Qt::transparent)) {
+        return m_tintColor;
+    }
+    return Qt::white;
+}
+
+QRgb QtAcrylicEffectHelper::getTintLayer() const
+{
+    // The acrylic brush without its noise, premultiplied.
+    QRgb layer = qPremultiply(getFillColor().rgba());
+    const QRgb tint = qPremultiply(getAppropriateTintColor().rgba());
+    const int opacity = qRound(qBound(qreal(0), m_tintOpacity, qreal(1)) * 255);
+    BlurKernels::kernels().sourceOver(reinterpret_cast<uchar *>(&layer), reinterpret_cast<const uchar *>(&tint), 1, opacity);
+    return layer;
 }
 
 void QtAcrylicEffectHelper::updateBehindWindowBackground()
@@ -302,54 +504,87 @@ void QtAcrylicEffectHelper::updateBehindWindowBackground()
     if (!checkWindow()) {
         return;
     }
-    if (!m_bluredWallpaper.isNull()) {
+    if (m_wallpaperAcquired) {
         return;
     }
-    const QSize size = Utilities::getScreenGeometry(m_window).size();
-    m_bluredWallpaper = QPixmap(size);
-    m_bluredWallpaper.fill(Qt::transparent);
-    QImage image = Utilities::getDesktopWallpaperImage();
-    // On some platforms we may not be able to get the desktop wallpaper, such as Linux and WebAssembly.
-    if (image.isNull()) {
+    // Every screen has a backdrop of its own, at its own resolution.
+    m_wallpaperKey = WallpaperStore::keyFor(m_window->screen(), 128);
+    // Shared with all the other helpers on the same screen, and prepared off the GUI thread.
+    const QFuture<QImage> future = WallpaperStore::acquire(m_wallpaperKey);
+    m_wallpaperAcquired = true;
+    // The backdrop of a screen the window has been on before is still there.
+    for (int i = m_parkedWallpaperKeys.size() - 1; i >= 0; --i) {
+        if (m_parkedWallpaperKeys.at(i).screenName == m_wallpaperKey.screenName) {
+            WallpaperStore::release(m_parkedWallpaperKeys.at(i));
+            m_parkedWallpaperKeys.removeAt(i);
+        }
+    }
+    if (future.isFinished() && (future.resultCount() > 0)) {
+        m_bluredWallpaper = future.result();
+    }
+    m_wallpaperWatcher.setFuture(future);
+}
+
+void QtAcrylicEffectHelper::handleScreenChange()
+{
+    if (m_wallpaperAcquired) {
+        // Kept until the window comes back, or the helper is done with all of them.
+        m_parkedWallpaperKeys.append(m_wallpaperKey);
+        m_wallpaperWatcher.setFuture({});
+        m_bluredWallpaper = {};
+        m_wallpaperAcquired = false;
+    }
+    prewarm();
+    Q_EMIT needsRepaint();
+}
+
+void QtAcrylicEffectHelper::handleBackdropChange(const QString &screenName)
+{
+    // Made again when the window comes back to that screen.
+    for (int i = m_parkedWallpaperKeys.size() - 1; i >= 0; --i) {
+        if (m_parkedWallpaperKeys.at(i).screenName == screenName) {
+            WallpaperStore::release(m_parkedWallpaperKeys.at(i));
+            m_parkedWallpaperKeys.removeAt(i);
+        }
+    }
+    if (!m_wallpaperAcquired || (m_wallpaperKey.screenName != screenName) || !m_window) {
         return;
     }
-    const Utilities::DesktopWallpaperAspectStyle aspectStyle = Utilities::getDesktopWallpaperAspectStyle();
-    QImage buffer(size, QImage::Format_ARGB32_Premultiplied);
-#ifdef Q_OS_WINDOWS
-    if ((aspectStyle == Utilities::DesktopWallpaperAspectStyle::Central) ||
-            (aspectStyle == Utilities::DesktopWallpaperAspectStyle::KeepRatioFit)) {
-        buffer.fill(Utilities::getDesktopBackgroundColor());
+    const WallpaperStore::Key oldKey = m_wallpaperKey;
+    m_wallpaperKey = WallpaperStore::keyFor(m_window->screen(), oldKey.radius);
+    const QFuture<QImage> future = WallpaperStore::acquire(m_wallpaperKey);
+    WallpaperStore::release(oldKey);
+    // The old backdrop stays until the new one is ready, unless it doesn't fit anymore.
+    if ((m_wallpaperKey.screenGeometry != oldKey.screenGeometry)
+            || !qFuzzyCompare(m_wallpaperKey.devicePixelRatio, oldKey.devicePixelRatio)) {
+        m_bluredWallpaper = {};
     }
-#endif
-    if (aspectStyle == Utilities::DesktopWallpaperAspectStyle::IgnoreRatioFit ||
-            aspectStyle == Utilities::DesktopWallpaperAspectStyle::KeepRatioFit ||
-            aspectStyle == Utilities::DesktopWallpaperAspectStyle::KeepRatioByExpanding) {
-        Qt::AspectRatioMode mode;
-        if (aspectStyle == Utilities::DesktopWallpaperAspectStyle::IgnoreRatioFit) {
-            mode = Qt::IgnoreAspectRatio;
-        } else if (aspectStyle == Utilities::DesktopWallpaperAspectStyle::KeepRatioFit) {
-            mode = Qt::KeepAspectRatio;
-        } else {
-            mode = Qt::KeepAspectRatioByExpanding;
+    if (future.isFinished() && (future.resultCount() > 0)) {
+        m_bluredWallpaper = future.result();
+    }
+    m_wallpaperWatcher.setFuture(future);
+    Q_EMIT needsRepaint();
+}
+
+void QtAcrylicEffectHelper::releaseWallpaper(const bool invalidate)
+{
+    for (auto &&key : qAsConst(m_parkedWallpaperKeys)) {
+        if (invalidate) {
+            WallpaperStore::invalidate(key);
         }
-        QSize newSize = image.size();
-        newSize.scale(size, mode);
-        image = image.scaled(newSize, Qt::IgnoreAspectRatio, Qt::FastTransformation);
+        WallpaperStore::release(key);
     }
-    if (aspectStyle == Utilities::DesktopWallpaperAspectStyle::Tiled) {
-        QPainter painterBuffer(&buffer);
-        painterBuffer.fillRect(QRect{{0, 0}, size}, image);
-    } else {
-        QPainter painterBuffer(&buffer);
-        const QRect rect = Utilities::alignedRect(Qt::LeftToRight, Qt::AlignCenter, image.size(), {{0, 0}, size});
-        painterBuffer.drawImage(rect.topLeft(), image);
+    m_parkedWallpaperKeys.clear();
+    if (!m_wallpaperAcquired) {
+        return;
     }
-    QPainter painter(&m_bluredWallpaper);
-#if 1
-    Utilities::blurImage(&painter, buffer, 128, false, false);
-#else
-    painter.drawImage(QPoint{0, 0}, buffer);
-#endif
+    m_wallpaperWatcher.setFuture({});
+    m_bluredWallpaper = {};
+    m_wallpaperAcquired = false;
+    if (invalidate) {
+        WallpaperStore::invalidate(m_wallpaperKey);
+    }
+    WallpaperStore::release(m_wallpaperKey);
 }
 
 bool QtAcrylicEffectHelper::checkWindow() const
@@ -25,7 +25,11 @@
 #pragma once
 
 #include "framelesshelper_global.h"
+#include "wallpaperstore.h"
 #include <QtGui/qbrush.h>
+#include <QtGui/qimage.h>
+#include <QtCore/qfuturewatcher.h>
+#include <QtCore/qvector.h>
 
 class FRAMELESSHELPER_EXPORT QtAcrylicEffectHelper : public QObject
 {
@@ -49,6 +53,8 @@ public Q_SLOTS:
     void uninstall();
 
     void clearWallpaper();
+    // Starts preparing the blurred wallpaper in the background, install() does it already.
+    void prewarm();
 
     void showWarning() const;
 
@@ -65,7 +71,14 @@ public Q_SLOTS:
 
 private:
     void paintBackground(QPainter *painter, const QRect &rect);
+    bool scaleBackdrop(const QSize &size);
+    void composeBackdrop(const QRgb tint, const int noiseOpacity);
+    QColor getAppropriateTintColor() const;
+    QRgb getTintLayer() const;
     void updateBehindWindowBackground();
+    void handleScreenChange();
+    void handleBackdropChange(const QString &screenName);
+    void releaseWallpaper(const bool invalidate);
     bool checkWindow() const;
 
 Q_SIGNALS:
@@ -73,11 +86,38 @@ Q_SIGNALS:
 
 private:
     QWindow *m_window = nullptr;
-    QBrush m_acrylicBrush = {};
+    // Made again by getAcrylicBrush() when it's needed, after any of its parameters changed.
+    mutable QBrush m_acrylicBrush = {};
+    mutable bool m_acrylicBrushDirty = true;
+    QColor m_alternativeTintColor = {};
+    QImage m_noiseTile = {}; // At the resolution of the backdrop and full opacity.
     QColor m_tintColor = {};
     qreal m_tintOpacity = 0.7;
     qreal m_noiseOpacity = 0.04;
-    QPixmap m_bluredWallpaper = {};
+    QImage m_bluredWallpaper = {}; // Shared through the WallpaperStore.
+    // The part of it behind the window at the resolution of the window, only made again when
+    // the window moved or resized or the backdrop changed.
+    QImage m_scaledBackdrop = {};
+    QPointF m_scaledBackdropOrigin = {};
+    qint64 m_scaledBackdropKey = 0;
+    // The same with the tint and the noise on top, what the window paints as long as they
+    // don't change.
+    QImage m_composition = {};
+    bool m_compositionValid = false;
+    QRgb m_compositionTint = 0;
+    int m_compositionNoiseOpacity = 0;
+    // What the last paint used, an animation changes them from one paint to the next.
+    QRgb m_paintedTint = 0;
+    int m_paintedNoiseOpacity = -1;
+    QVector<int> m_columnOffsets = {};
+    QVector<quint16> m_columnWeights = {};
+    QVector<QRgb> m_rowBuffer = {};
+    QVector<QRgb> m_tintRow = {};
+    WallpaperStore::Key m_wallpaperKey = {};
+    bool m_wallpaperAcquired = false;
+    // Of the other screens the window has been on.
+    QVector<WallpaperStore::Key> m_parkedWallpaperKeys = {};
+    QFutureWatcher<QImage> m_wallpaperWatcher;
     QColor m_frameColor = {};
     qreal m_frameThickness = 1.0;
 };
@@ -55,7 +55,7 @@ void QtAcrylicWidget::setTintColor(const QColor &value)
         QPalette pal = palette();
         pal.setColor(backgroundRole(), m_acrylicHelper.getTintColor());
         setPalette(pal);
-        //m_acrylicHelper.updateAcrylicBrush(tintColor());
+        m_acrylicHelper.updateAcrylicBrush(tintColor());
         update();
         Q_EMIT tintColorChanged();
     }
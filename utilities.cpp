@@ -23,306 +23,110 @@
  */
 
 #include "utilities.h"
-#include <QtGui/private/qguiapplication_p.h>
+#include "blurengine.h"
+#include "blurcache.h"
+#include "blurkernels.h"
+#include <QtGui/qguiapplication.h>
 #include <QtGui/qscreen.h>
 #include <QtGui/qpainter.h>
-#include <QtGui/private/qmemrotate_p.h>
 #include <QtCore/qdebug.h>
+#include <QtCore/qthread.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 
-/*
- * Copied from https://code.qt.io/cgit/qt/qtbase.git/tree/src/widgets/effects/qpixmapfilter.cpp
- * With minor modifications, most of them are format changes.
- * They are exported functions of Qt, we can make use of them directly, but they are in the QtWidgets
- * module, I don't want our library have such a dependency.
- */
-
-#ifndef AVG
-#define AVG(a,b)  ( ((((a)^(b)) & 0xfefefefeUL) >> 1) + ((a)&(b)) )
-#endif
+static std::atomic_int g_blurThreadCount = 0;
+static std::atomic_int g_blurMultiThreadingThreshold = 512 * 512;
 
-#ifndef AVG16
-#define AVG16(a,b)  ( ((((a)^(b)) & 0xf7deUL) >> 1) + ((a)&(b)) )
-#endif
-
-template<const int shift>
-static inline int qt_static_shift(const int value)
+// Both overloads of blurImage() and every job of blurImages() end up in here.
+static inline void blurImageWith(BlurEngine &engine, QPainter *painter, QImage &blurImage, const qreal radius, const bool quality,
+                                 const bool alphaOnly, const int transposed, const Utilities::BlurAlgorithm algorithm, const bool pyramid)
 {
-    if (shift == 0) {
-        return value;
-    } else if (shift > 0) {
-        return value << (uint(shift) & 0x1f);
-    } else {
-        return value >> (uint(-shift) & 0x1f);
+    if (blurImage.isNull()) {
+        return;
     }
+    engine.setAlgorithm(algorithm);
+    engine.setImprovedQuality(quality);
+    if (!pyramid) {
+        // Not cached, see blurcache.h.
+        engine.blur(blurImage, radius, transposed);
+        return;
+    }
+    const BlurCache::Key key = {blurImage.cacheKey(), radius, transposed, algorithm, quality, alphaOnly};
+    if (BlurCache::find(key, blurImage)) {
+        if (painter) {
+            painter->drawImage(QRect{QPoint{0, 0}, blurImage.size() / blurImage.devicePixelRatio()}, blurImage);
+        }
+        return;
+    }
+    engine.blur(painter, blurImage, radius, alphaOnly, transposed);
+    blurImage = engine.takeResult();
+    BlurCache::insert(key, blurImage);
 }
 
-template<const int aprec, const int zprec>
-static inline void qt_blurinner(uchar *bptr, int &zR, int &zG, int &zB, int &zA, const int alpha)
+void Utilities::blurImage(QPainter *painter, QImage &blurImage, const qreal radius, const bool quality, const bool alphaOnly, const int transposed, const BlurAlgorithm algorithm)
 {
-    QRgb *pixel = reinterpret_cast<QRgb *>(bptr);
-#define Z_MASK (0xff << zprec)
-    const int A_zprec = qt_static_shift<zprec - 24>(*pixel) & Z_MASK;
-    const int R_zprec = qt_static_shift<zprec - 16>(*pixel) & Z_MASK;
-    const int G_zprec = qt_static_shift<zprec - 8>(*pixel)  & Z_MASK;
-    const int B_zprec = qt_static_shift<zprec>(*pixel)      & Z_MASK;
-#undef Z_MASK
-    const int zR_zprec = zR >> aprec;
-    const int zG_zprec = zG >> aprec;
-    const int zB_zprec = zB >> aprec;
-    const int zA_zprec = zA >> aprec;
-    zR += alpha * (R_zprec - zR_zprec);
-    zG += alpha * (G_zprec - zG_zprec);
-    zB += alpha * (B_zprec - zB_zprec);
-    zA += alpha * (A_zprec - zA_zprec);
-#define ZA_MASK (0xff << (zprec + aprec))
-    *pixel =
-        qt_static_shift<24 - zprec - aprec>(zA & ZA_MASK)
-        | qt_static_shift<16 - zprec - aprec>(zR & ZA_MASK)
-        | qt_static_shift<8 - zprec - aprec>(zG & ZA_MASK)
-        | qt_static_shift<-zprec - aprec>(zB & ZA_MASK);
-#undef ZA_MASK
+    BlurEngine engine;
+    blurImageWith(engine, painter, blurImage, radius, quality, alphaOnly, transposed, algorithm, true);
 }
 
-static const int alphaIndex = ((QSysInfo::ByteOrder == QSysInfo::BigEndian) ? 0 : 3);
-
-template<const int aprec, const int zprec>
-static inline void qt_blurinner_alphaOnly(uchar *bptr, int &z, const int alpha)
+int Utilities::getBlurThreadCount()
 {
-    const int A_zprec = int(*(bptr)) << zprec;
-    const int z_zprec = z >> aprec;
-    z += alpha * (A_zprec - z_zprec);
-    *(bptr) = z >> (zprec + aprec);
+    return g_blurThreadCount.load(std::memory_order_relaxed);
 }
 
-template<const int aprec, const int zprec, const bool alphaOnly>
-static inline void qt_blurrow(QImage &im, const int line, const int alpha)
+void Utilities::setBlurThreadCount(const int count)
 {
-    uchar *bptr = im.scanLine(line);
-    int zR = 0, zG = 0, zB = 0, zA = 0;
-    if (alphaOnly && (im.format() != QImage::Format_Indexed8)) {
-        bptr += alphaIndex;
-    }
-    const int stride = im.depth() >> 3;
-    const int im_width = im.width();
-    for (int index = 0; index < im_width; ++index) {
-        if (alphaOnly) {
-            qt_blurinner_alphaOnly<aprec, zprec>(bptr, zA, alpha);
-        } else {
-            qt_blurinner<aprec, zprec>(bptr, zR, zG, zB, zA, alpha);
-        }
-        bptr += stride;
-    }
-    bptr -= stride;
-    for (int index = im_width - 2; index >= 0; --index) {
-        bptr -= stride;
-        if (alphaOnly) {
-            qt_blurinner_alphaOnly<aprec, zprec>(bptr, zA, alpha);
-        } else {
-            qt_blurinner<aprec, zprec>(bptr, zR, zG, zB, zA, alpha);
-        }
-    }
+    g_blurThreadCount.store(qMax(count, 0), std::memory_order_relaxed);
 }
 
-/*
- *  expblur(QImage &img, const qreal radius)
- *
- *  Based on exponential blur algorithm by Jani Huhtanen
- *
- *  In-place blur of image 'img' with kernel
- *  of approximate radius 'radius'.
- *
- *  Blurs with two sided exponential impulse
- *  response.
- *
- *  aprec = precision of alpha parameter
- *  in fixed-point format 0.aprec
- *
- *  zprec = precision of state parameters
- *  zR,zG,zB and zA in fp format 8.zprec
- */
-template<const int aprec, const int zprec, const bool alphaOnly>
-static inline void expblur(QImage &img, const qreal radius, const bool improvedQuality = false, const int transposed = 0)
+int Utilities::getBlurMultiThreadingThreshold()
 {
-    qreal _radius = radius;
-    // halve the radius if we're using two passes
-    if (improvedQuality) {
-        _radius *= 0.5;
-    }
-    Q_ASSERT((img.format() == QImage::Format_ARGB32_Premultiplied)
-             || (img.format() == QImage::Format_RGB32)
-             || (img.format() == QImage::Format_Indexed8)
-             || (img.format() == QImage::Format_Grayscale8));
-    // choose the alpha such that pixels at radius distance from a fully
-    // saturated pixel will have an alpha component of no greater than
-    // the cutOffIntensity
-    const qreal cutOffIntensity = 2;
-    const int alpha = _radius <= qreal(1e-5)
-                    ? ((1 << aprec)-1)
-                    : qRound((1<<aprec)*(1 - qPow(cutOffIntensity * (1 / qreal(255)), 1 / _radius)));
-    int img_height = img.height();
-    for (int row = 0; row < img_height; ++row) {
-        for (int i = 0; i <= int(improvedQuality); ++i) {
-            qt_blurrow<aprec, zprec, alphaOnly>(img, row, alpha);
-        }
-    }
-    QImage temp(img.height(), img.width(), img.format());
-    temp.setDevicePixelRatio(img.devicePixelRatio());
-    if (transposed >= 0) {
-        if (img.depth() == 8) {
-            qt_memrotate270(reinterpret_cast<const quint8*>(img.bits()),
-                            img.width(), img.height(), img.bytesPerLine(),
-                            reinterpret_cast<quint8*>(temp.bits()),
-                            temp.bytesPerLine());
-        } else {
-            qt_memrotate270(reinterpret_cast<const quint32*>(img.bits()),
-                            img.width(), img.height(), img.bytesPerLine(),
-                            reinterpret_cast<quint32*>(temp.bits()),
-                            temp.bytesPerLine());
-        }
-    } else {
-        if (img.depth() == 8) {
-            qt_memrotate90(reinterpret_cast<const quint8*>(img.bits()),
-                           img.width(), img.height(), img.bytesPerLine(),
-                           reinterpret_cast<quint8*>(temp.bits()),
-                           temp.bytesPerLine());
-        } else {
-            qt_memrotate90(reinterpret_cast<const quint32*>(img.bits()),
-                           img.width(), img.height(), img.bytesPerLine(),
-                           reinterpret_cast<quint32*>(temp.bits()),
-                           temp.bytesPerLine());
-        }
-    }
-    img_height = temp.height();
-    for (int row = 0; row < img_height; ++row) {
-        for (int i = 0; i <= int(improvedQuality); ++i) {
-            qt_blurrow<aprec, zprec, alphaOnly>(temp, row, alpha);
-        }
-    }
-    if (transposed == 0) {
-        if (img.depth() == 8) {
-            qt_memrotate90(reinterpret_cast<const quint8*>(temp.bits()),
-                           temp.width(), temp.height(), temp.bytesPerLine(),
-                           reinterpret_cast<quint8*>(img.bits()),
-                           img.bytesPerLine());
-        } else {
-            qt_memrotate90(reinterpret_cast<const quint32*>(temp.bits()),
-                           temp.width(), temp.height(), temp.bytesPerLine(),
-                           reinterpret_cast<quint32*>(img.bits()),
-                           img.bytesPerLine());
-        }
-    } else {
-        img = temp;
-    }
+    return g_blurMultiThreadingThreshold.load(std::memory_order_relaxed);
 }
 
-static inline QImage qt_halfScaled(const QImage &source)
+void Utilities::setBlurMultiThreadingThreshold(const int threshold)
 {
-    if (source.width() < 2 || source.height() < 2) {
-        return {};
-    }
-    QImage srcImage = source;
-    if (source.format() == QImage::Format_Indexed8 || source.format() == QImage::Format_Grayscale8) {
-        // assumes grayscale
-        QImage dest(source.width() / 2, source.height() / 2, srcImage.format());
-        dest.setDevicePixelRatio(source.devicePixelRatio());
-        const uchar *src = reinterpret_cast<const uchar*>(const_cast<const QImage &>(srcImage).bits());
-        qsizetype sx = srcImage.bytesPerLine();
-        qsizetype sx2 = sx << 1;
-        uchar *dst = reinterpret_cast<uchar*>(dest.bits());
-        qsizetype dx = dest.bytesPerLine();
-        int ww = dest.width();
-        int hh = dest.height();
-        for (int y = hh; y; --y, dst += dx, src += sx2) {
-            const uchar *p1 = src;
-            const uchar *p2 = src + sx;
-            uchar *q = dst;
-            for (int x = ww; x; --x, ++q, p1 += 2, p2 += 2) {
-                *q = ((int(p1[0]) + int(p1[1]) + int(p2[0]) + int(p2[1])) + 2) >> 2;
-            }
-        }
-        return dest;
-    } else if (source.format() == QImage::Format_ARGB8565_Premultiplied) {
-        QImage dest(source.width() / 2, source.height() / 2, srcImage.format());
-        dest.setDevicePixelRatio(source.devicePixelRatio());
-        const uchar *src = reinterpret_cast<const uchar*>(const_cast<const QImage &>(srcImage).bits());
-        qsizetype sx = srcImage.bytesPerLine();
-        qsizetype sx2 = sx << 1;
-        uchar *dst = reinterpret_cast<uchar*>(dest.bits());
-        qsizetype dx = dest.bytesPerLine();
-        int ww = dest.width();
-        int hh = dest.height();
-        for (int y = hh; y; --y, dst += dx, src += sx2) {
-            const uchar *p1 = src;
-            const uchar *p2 = src + sx;
-            uchar *q = dst;
-            for (int x = ww; x; --x, q += 3, p1 += 6, p2 += 6) {
-                // alpha
-                q[0] = AVG(AVG(p1[0], p1[3]), AVG(p2[0], p2[3]));
-                // rgb
-                const quint16 p16_1 = (p1[2] << 8) | p1[1];
-                const quint16 p16_2 = (p1[5] << 8) | p1[4];
-                const quint16 p16_3 = (p2[2] << 8) | p2[1];
-                const quint16 p16_4 = (p2[5] << 8) | p2[4];
-                const quint16 result = AVG16(AVG16(p16_1, p16_2), AVG16(p16_3, p16_4));
-                q[1] = result & 0xff;
-                q[2] = result >> 8;
-            }
-        }
-        return dest;
-    } else if ((source.format() != QImage::Format_ARGB32_Premultiplied) && (source.format() != QImage::Format_RGB32)) {
-        srcImage = source.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-    }
-    QImage dest(source.width() / 2, source.height() / 2, srcImage.format());
-    dest.setDevicePixelRatio(source.devicePixelRatio());
-    const quint32 *src = reinterpret_cast<const quint32*>(const_cast<const QImage &>(srcImage).bits());
-    qsizetype sx = srcImage.bytesPerLine() >> 2;
-    qsizetype sx2 = sx << 1;
-    quint32 *dst = reinterpret_cast<quint32*>(dest.bits());
-    qsizetype dx = dest.bytesPerLine() >> 2;
-    int ww = dest.width();
-    int hh = dest.height();
-    for (int y = hh; y; --y, dst += dx, src += sx2) {
-        const quint32 *p1 = src;
-        const quint32 *p2 = src + sx;
-        quint32 *q = dst;
-        for (int x = ww; x; --x, q++, p1 += 2, p2 += 2) {
-            *q = AVG(AVG(p1[0], p1[1]), AVG(p2[0], p2[1]));
-        }
-    }
-    return dest;
+    g_blurMultiThreadingThreshold.store(qMax(threshold, 0), std::memory_order_relaxed);
 }
 
-void Utilities::blurImage(QPainter *painter, QImage &blurImage, const qreal radius, const bool quality, const bool alphaOnly, const int transposed)
+void Utilities::blurImage(QImage &blurImage, const qreal radius, const bool quality, const int transposed, const BlurAlgorithm algorithm)
 {
-    if ((blurImage.format() != QImage::Format_ARGB32_Premultiplied) && (blurImage.format() != QImage::Format_RGB32)) {
-        blurImage = blurImage.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-    }
-    qreal _radius = radius;
-    qreal scale = 1;
-    if ((_radius >= 4) && (blurImage.width() >= 2) && (blurImage.height() >= 2)) {
-        blurImage = qt_halfScaled(blurImage);
-        scale = 2;
-        _radius *= 0.5;
-    }
-    if (alphaOnly) {
-        expblur<12, 10, true>(blurImage, _radius, quality, transposed);
-    } else {
-        expblur<12, 10, false>(blurImage, _radius, quality, transposed);
-    }
-    if (painter) {
-        painter->scale(scale, scale);
-        painter->setRenderHint(QPainter::SmoothPixmapTransform);
-        painter->drawImage(QRect{QPoint{0, 0}, blurImage.size() / blurImage.devicePixelRatio()}, blurImage);
-    }
+    BlurEngine engine;
+    blurImageWith(engine, nullptr, blurImage, radius, quality, false, transposed, algorithm, false);
 }
 
-void Utilities::blurImage(QImage &blurImage, const qreal radius, const bool quality, const int transposed)
+void Utilities::blurImages(QList<BlurJob> &jobs)
 {
-    if ((blurImage.format() == QImage::Format_Indexed8) || (blurImage.format() == QImage::Format_Grayscale8)) {
-        expblur<12, 10, true>(blurImage, radius, quality, transposed);
-    } else {
-        expblur<12, 10, false>(blurImage, radius, quality, transposed);
+    if (jobs.isEmpty()) {
+        return;
+    }
+    // Largest images first, so that no thread picks up a big one when the others are
+    // almost done. The jobs are handed out one by one from this list, a thread that is
+    // done with a job simply takes the next one.
+    QVector<BlurJob *> queue = {};
+    queue.reserve(jobs.size());
+    for (auto &&job : jobs) {
+        queue.append(&job);
+    }
+    std::stable_sort(queue.begin(), queue.end(), [](const BlurJob *lhs, const BlurJob *rhs) {
+        return (qint64(lhs->image.width()) * qint64(lhs->image.height())) > (qint64(rhs->image.width()) * qint64(rhs->image.height()));
+    });
+    const int count = getBlurThreadCount();
+    const int threadCount = qMin((count > 0) ? count : QThread::idealThreadCount(), int(jobs.size()));
+    // One engine per thread, its buffers are reused by all the jobs the thread takes.
+    const std::unique_ptr<BlurEngine[]> engines(new BlurEngine[threadCount]);
+    for (int worker = 0; worker != threadCount; ++worker) {
+        // The threads are already busy with whole images, only a lone one splits up its image.
+        engines[worker].setThreadCount((threadCount > 1) ? 1 : -1);
     }
+    BlurKernels::parallelFor(int(queue.size()), 1, threadCount, [&](const int begin, const int end, const int worker) {
+        for (int index = begin; index < end; ++index) {
+            BlurJob *job = queue.at(index);
+            blurImageWith(engines[worker], nullptr, job->image, job->radius, job->quality, job->alphaOnly,
+                          job->transposed, job->algorithm, !job->fullResolution);
+        }
+    });
 }
 
 ///////////////////////////////////////////////////
@@ -336,7 +140,18 @@ void Utilities::blurImage(QImage &blurImage, const qreal radius, const bool qual
 
 static inline Qt::Alignment visualAlignment(const Qt::LayoutDirection direction, const Qt::Alignment alignment)
 {
-    return QGuiApplicationPrivate::visualAlignment(direction, alignment);
+    // Same as QGuiApplicationPrivate::visualAlignment(), without the private header.
+    Qt::Alignment align = alignment;
+    if (!(align & Qt::AlignHorizontal_Mask)) {
+        align |= Qt::AlignLeft;
+    }
+    if (!(align & Qt::AlignAbsolute) && (align & (Qt::AlignLeft | Qt::AlignRight))) {
+        if (direction == Qt::RightToLeft) {
+            align ^= (Qt::AlignLeft | Qt::AlignRight);
+        }
+        align |= Qt::AlignAbsolute;
+    }
+    return align;
 }
 
 QRect Utilities::alignedRect(const Qt::LayoutDirection direction, const Qt::Alignment alignment, const QSize &size, const QRect &rectangle)
@@ -409,6 +224,11 @@ bool Utilities::forceDisableWallpaperBlur()
     return qEnvironmentVariableIsSet(_flh_global::_flh_acrylic_forceDisableWallpaperBlur_flag);
 }
 
+bool Utilities::forceScalarBlur()
+{
+    return qEnvironmentVariableIsSet(_flh_global::_flh_acrylic_forceScalarBlur_flag);
+}
+
 bool Utilities::shouldUseNativeTitleBar()
 {
     return qEnvironmentVariableIsSet(_flh_global::_flh_useNativeTitleBar_flag);
@@ -27,6 +27,8 @@
 #include "framelesshelper_global.h"
 #include <QtGui/qcolor.h>
 #include <QtGui/qwindow.h>
+#include <QtGui/qimage.h>
+#include <QtCore/qfuture.h>
 
 namespace Utilities {
 
@@ -47,6 +49,17 @@ enum class DesktopWallpaperAspectStyle
     Span
 };
 
+// All of them have a constant cost per pixel, no matter how large the radius is.
+// Except for Exponential, the radius is taken as three standard deviations of
+// the Gaussian blur they approximate.
+enum class BlurAlgorithm
+{
+    Exponential, // Qt's recursive exponential blur. "quality" runs it twice.
+    Box, // Three passes of a box filter, five if "quality" is set.
+    Stack, // Mario Klingemann's stack blur.
+    Gaussian // Young and van Vliet's recursive Gaussian.
+};
+
 // Common
 FRAMELESSHELPER_EXPORT bool shouldUseWallpaperBlur();
 FRAMELESSHELPER_EXPORT bool shouldUseTraditionalBlur();
@@ -59,6 +72,8 @@ FRAMELESSHELPER_EXPORT bool isDarkThemeEnabled();
 
 FRAMELESSHELPER_EXPORT QWindow *findWindow(const WId winId);
 
+// "screen" is an index of QGuiApplication::screens(), -1 is the primary one.
+FRAMELESSHELPER_EXPORT QString getDesktopWallpaperFilePath(const int screen = -1);
 FRAMELESSHELPER_EXPORT QImage getDesktopWallpaperImage(const int screen = -1);
 FRAMELESSHELPER_EXPORT QColor getDesktopBackgroundColor(const int screen = -1);
 FRAMELESSHELPER_EXPORT DesktopWallpaperAspectStyle getDesktopWallpaperAspectStyle(const int screen = -1);
@@ -71,12 +86,69 @@ FRAMELESSHELPER_EXPORT QRect getScreenGeometry(const QPoint &pos);
 
 FRAMELESSHELPER_EXPORT QRect alignedRect(const Qt::LayoutDirection direction, const Qt::Alignment alignment, const QSize &size, const QRect &rectangle);
 
-FRAMELESSHELPER_EXPORT void blurImage(QImage &blurImage, const qreal radius, const bool quality, const int transposed = 0);
-FRAMELESSHELPER_EXPORT void blurImage(QPainter *painter, QImage &blurImage, const qreal radius, const bool quality, const bool alphaOnly, const int transposed = 0);
+FRAMELESSHELPER_EXPORT void blurImage(QImage &blurImage, const qreal radius, const bool quality, const int transposed = 0, const BlurAlgorithm algorithm = BlurAlgorithm::Exponential);
+// With "alphaOnly", only the alpha channel is blurred and "blurImage" becomes an Alpha8 image.
+FRAMELESSHELPER_EXPORT void blurImage(QPainter *painter, QImage &blurImage, const qreal radius, const bool quality, const bool alphaOnly, const int transposed = 0, const BlurAlgorithm algorithm = BlurAlgorithm::Exponential);
+struct BlurJob
+{
+    QImage image = {}; // Replaced by the result.
+    qreal radius = 0.0;
+    bool quality = false;
+    bool alphaOnly = false;
+    int transposed = 0;
+    BlurAlgorithm algorithm = BlurAlgorithm::Exponential;
+    // Blur like blurImage(QImage &, ...) does, instead of like the QPainter overload without
+    // a painter. "alphaOnly" is ignored then.
+    bool fullResolution = false;
+};
+
+// Blurs all the images of "jobs", several of them at the same time on up to
+// getBlurThreadCount() threads. Returns when all of them are done.
+FRAMELESSHELPER_EXPORT void blurImages(QList<BlurJob> &jobs);
+
+// Blurs a copy of "image" like the QPainter overload above, but on a low priority background
+// thread. Cancel the returned future to drop the job. A newer request with the same (non-null)
+// "owner", a window for example, cancels the older ones which haven't finished yet.
+FRAMELESSHELPER_EXPORT QFuture<QImage> blurImageAsync(const QImage &image, const qreal radius, const bool quality, const bool alphaOnly = false, const BlurAlgorithm algorithm = BlurAlgorithm::Exponential, const void *owner = nullptr);
+
+// Results of the QPainter overload of blurImage() (and of the blurImages() jobs which aren't
+// "fullResolution") are kept in a process wide LRU cache, an identical request (the
+// same source image, see QImage::cacheKey(), and the same parameters) gets an implicitly
+// shared copy of the earlier result. The budget (64 MiB by default) is in bytes, results
+// which don't fit in at all aren't cached, zero disables the cache.
+struct BlurCacheStatistics
+{
+    quint64 hits = 0;
+    quint64 misses = 0;
+    int count = 0; // Cached results.
+    qint64 bytes = 0; // Their size, in KiB steps.
+    qint64 budget = 0;
+};
+
+FRAMELESSHELPER_EXPORT qint64 getBlurCacheBudget();
+FRAMELESSHELPER_EXPORT void setBlurCacheBudget(const qint64 bytes);
+FRAMELESSHELPER_EXPORT void clearBlurCache();
+FRAMELESSHELPER_EXPORT BlurCacheStatistics getBlurCacheStatistics();
+FRAMELESSHELPER_EXPORT void resetBlurCacheStatistics();
+
+// ARGB32_Premultiplied, RGB32, RGBA8888_Premultiplied, RGBX8888, RGB888, Grayscale8 and
+// Alpha8 images are blurred in their own format. Any other one is converted to a premultiplied
+// 32-bit format first, which costs a full copy of the image. The count of these conversions
+// since the start of the process (or the last reset) helps to find the callers which pay it.
+FRAMELESSHELPER_EXPORT quint64 getBlurFormatConversionCount();
+FRAMELESSHELPER_EXPORT void resetBlurFormatConversionCount();
+
+// Images with at least "threshold" pixels are blurred on up to "count" threads.
+// A count of zero (the default) means QThread::idealThreadCount(), one disables it.
+FRAMELESSHELPER_EXPORT int getBlurThreadCount();
+FRAMELESSHELPER_EXPORT void setBlurThreadCount(const int count);
+FRAMELESSHELPER_EXPORT int getBlurMultiThreadingThreshold();
+FRAMELESSHELPER_EXPORT void setBlurMultiThreadingThreshold(const int threshold);
 
 FRAMELESSHELPER_EXPORT bool disableExtraProcessingForBlur();
 FRAMELESSHELPER_EXPORT bool forceEnableTraditionalBlur();
 FRAMELESSHELPER_EXPORT bool forceDisableWallpaperBlur();
+FRAMELESSHELPER_EXPORT bool forceScalarBlur();
 FRAMELESSHELPER_EXPORT bool shouldUseNativeTitleBar();
 
 FRAMELESSHELPER_EXPORT bool isWindowFixedSize(const QWindow *window);
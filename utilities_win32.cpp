@@ -35,6 +35,7 @@
 #include <QtCore/qlibrary.h>
 #include <QtCore/qt_windows.h>
 #include <QtGui/qguiapplication.h>
+#include <QtGui/qscreen.h>
 #include <QtCore/qdebug.h>
 #include <QtCore/qfileinfo.h>
 #include <dwmapi.h>
@@ -488,7 +489,46 @@ void Utilities::updateFrameMargins(const QWindow *window, const bool reset)
     }
 }
 
-QImage Utilities::getDesktopWallpaperImage(const int screen)
+// The rectangle of the monitor behind QGuiApplication::screens().at(screen), which is how
+// IDesktopWallpaper tells its monitors apart. Qt names its screens after their GDI devices.
+static inline bool getScreenMonitorRect(const int screen, RECT *rect)
+{
+    Q_ASSERT(rect);
+    if (!rect) {
+        return false;
+    }
+    const auto screens = QGuiApplication::screens();
+    // The primary screen always comes first.
+    const int index = qMax(screen, 0);
+    if (index >= screens.size()) {
+        return false;
+    }
+    struct MonitorSearch
+    {
+        QString deviceName = {};
+        RECT rect = {};
+        bool found = false;
+    } search = {};
+    search.deviceName = screens.at(index)->name();
+    EnumDisplayMonitors(nullptr, nullptr, [](HMONITOR monitor, HDC, LPRECT, LPARAM param) -> BOOL {
+        const auto search = reinterpret_cast<MonitorSearch *>(param);
+        MONITORINFOEXW info;
+        SecureZeroMemory(&info, sizeof(info));
+        info.cbSize = sizeof(info);
+        if ((GetMonitorInfoW(monitor, &info) != FALSE) && (QString::fromWCharArray(info.szDevice) == search->deviceName)) {
+            search->rect = info.rcMonitor;
+            search->found = true;
+            return FALSE;
+        }
+        return TRUE;
+    }, reinterpret_cast<LPARAM>(&search));
+    if (search.found) {
+        *rect = search.rect;
+    }
+    return search.found;
+}
+
+QString Utilities::getDesktopWallpaperFilePath(const int screen)
 {
     if (isWin8OrGreater()) {
         if (SUCCEEDED(CoInitialize(nullptr))) {
@@ -509,12 +549,28 @@ QImage Utilities::getDesktopWallpaperImage(const int screen)
                         qWarning() << "Screen number above total screen count.";
                         return {};
                     }
-                    const UINT monitorIndex = qMax(screen, 0);
+                    UINT monitorIndex = qMax(screen, 0);
+                    // Its own order of the monitors doesn't have to be the one of Qt.
+                    RECT screenRect = {};
+                    if (getScreenMonitorRect(screen, &screenRect)) {
+                        for (UINT i = 0; i != monitorCount; ++i) {
+                            LPWSTR id = nullptr;
+                            RECT monitorRect = {};
+                            const bool match = SUCCEEDED(pDesktopWallpaper->GetMonitorDevicePathAt(i, &id)) && id
+                                    && SUCCEEDED(pDesktopWallpaper->GetMonitorRECT(id, &monitorRect))
+                                    && (EqualRect(&monitorRect, &screenRect) != FALSE);
+                            CoTaskMemFree(id);
+                            if (match) {
+                                monitorIndex = i;
+                                break;
+                            }
+                        }
+                    }
                     LPWSTR monitorId = nullptr;
                     if (SUCCEEDED(pDesktopWallpaper->GetMonitorDevicePathAt(monitorIndex, &monitorId)) && monitorId) {
                         LPWSTR wallpaperPath = nullptr;
                         if (SUCCEEDED(pDesktopWallpaper->GetWallpaper(monitorId, &wallpaperPath)) && wallpaperPath) {
-                            return QImage(QString::fromWCharArray(wallpaperPath));
+                            return QString::fromWCharArray(wallpaperPath);
                         } else {
                             qWarning() << "IDesktopWallpaper::GetWallpaper() failed.";
                         }
@@ -546,7 +602,7 @@ QImage Utilities::getDesktopWallpaperImage(const int screen)
             WCHAR wallpaperPath[MAX_PATH] = {};
             // TODO: AD_GETWP_BMP, AD_GETWP_IMAGE, AD_GETWP_LAST_APPLIED. What's the difference?
             if (SUCCEEDED(pActiveDesktop->GetWallpaper(wallpaperPath, MAX_PATH, AD_GETWP_LAST_APPLIED))) {
-                return QImage(QString::fromWCharArray(wallpaperPath));
+                return QString::fromWCharArray(wallpaperPath);
             } else {
                 qWarning() << "IActiveDesktop::GetWallpaper() failed.";
             }
@@ -557,22 +613,32 @@ QImage Utilities::getDesktopWallpaperImage(const int screen)
         qWarning() << "Failed to initialize COM.";
     }
     qDebug() << "Shell API failed. Using SystemParametersInfoW instead.";
-    LPWSTR wallpaperPath = nullptr;
+    WCHAR wallpaperPath[MAX_PATH] = {};
     if (SystemParametersInfoW(SPI_GETDESKWALLPAPER, MAX_PATH, wallpaperPath, 0) != FALSE) {
-        return QImage(QString::fromWCharArray(wallpaperPath));
+        return QString::fromWCharArray(wallpaperPath);
     }
     qWarning() << "SystemParametersInfoW failed. Reading from the registry instead.";
     const QSettings settings(g_desktopRegistryKey, QSettings::NativeFormat);
     const QString path = settings.value(QStringLiteral("WallPaper")).toString();
     if (QFileInfo::exists(path)) {
-        return QImage(path);
+        return path;
     }
     qWarning() << "Failed to read the registry.";
     return {};
 }
 
+QImage Utilities::getDesktopWallpaperImage(const int screen)
+{
+    const QString path = getDesktopWallpaperFilePath(screen);
+    if (path.isEmpty()) {
+        return {};
+    }
+    return QImage(path);
+}
+
 QColor Utilities::getDesktopBackgroundColor(const int screen)
 {
+    // Windows has a single background color for all the monitors.
     Q_UNUSED(screen);
     if (isWin8OrGreater()) {
         if (SUCCEEDED(CoInitialize(nullptr))) {
@@ -608,6 +674,7 @@ QColor Utilities::getDesktopBackgroundColor(const int screen)
 
 Utilities::DesktopWallpaperAspectStyle Utilities::getDesktopWallpaperAspectStyle(const int screen)
 {
+    // Windows has a single position for the wallpapers of all the monitors.
     Q_UNUSED(screen);
     if (isWin8OrGreater()) {
         if (SUCCEEDED(CoInitialize(nullptr))) {
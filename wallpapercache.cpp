@@ -0,0 +1,227 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2021 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "wallpapercache.h"
+#include <QtCore/qdebug.h>
+#include <QtCore/qdir.h>
+#include <QtCore/qfile.h>
+#include <QtCore/qfileinfo.h>
+#include <QtCore/qdatetime.h>
+#include <QtCore/qsavefile.h>
+#include <QtCore/qstandardpaths.h>
+#include <QtCore/qcryptographichash.h>
+#include <QtCore/qvector.h>
+#include <cstring>
+#include <type_traits>
+
+namespace {
+
+constexpr quint32 g_magic = 0x46574c43; // "FWLC"
+constexpr quint32 g_formatVersion = 1;
+// The pixels start at the next page, a mapping of them is page aligned.
+constexpr qint64 g_headerSize = 4096;
+
+struct WallpaperCacheHeader
+{
+    quint32 magic = g_magic;
+    quint32 formatVersion = g_formatVersion;
+    quint32 algorithm = 0;
+    qint32 aspectStyle = 0;
+    qint64 lastModified = 0;
+    qint64 fileSize = 0;
+    qint32 screenWidth = 0;
+    qint32 screenHeight = 0;
+    double devicePixelRatio = 0.0;
+    double radius = 0.0;
+    quint32 backgroundColor = 0;
+    qint32 imageWidth = 0;
+    qint32 imageHeight = 0;
+    qint32 bytesPerLine = 0;
+    qint32 imageFormat = 0;
+    qint32 pathLength = 0; // In UTF-16 code units, they follow the header.
+};
+
+// Written and compared as it is, without any padding in between the fields.
+static_assert(std::is_trivially_copyable<WallpaperCacheHeader>::value && (sizeof(WallpaperCacheHeader) == 80), "Unexpected header layout.");
+
+constexpr int g_maxPathLength = int(g_headerSize - sizeof(WallpaperCacheHeader)) / int(sizeof(char16_t));
+
+}
+
+static inline WallpaperCacheHeader headerFor(const WallpaperCache::Key &key)
+{
+    WallpaperCacheHeader header = {};
+    header.algorithm = key.algorithm;
+    header.aspectStyle = static_cast<qint32>(key.aspectStyle);
+    header.lastModified = key.lastModified;
+    header.fileSize = key.fileSize;
+    header.screenWidth = key.screenSize.width();
+    header.screenHeight = key.screenSize.height();
+    header.devicePixelRatio = key.devicePixelRatio;
+    header.radius = key.radius;
+    header.backgroundColor = key.backgroundColor;
+    header.imageWidth = key.screenSize.width();
+    header.imageHeight = key.screenSize.height();
+    header.bytesPerLine = key.screenSize.width() * 4;
+    header.imageFormat = static_cast<qint32>(QImage::Format_ARGB32_Premultiplied);
+    header.pathLength = static_cast<qint32>(key.path.size());
+    return header;
+}
+
+static inline QString cacheDirPath()
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (dir.isEmpty()) {
+        return {};
+    }
+    return QDir(dir).filePath(QStringLiteral("FramelessHelper"));
+}
+
+// What the entries of a screen and screen configuration start with.
+static inline QString cacheFilePrefix(const WallpaperCache::Key &key)
+{
+    const QByteArray screenId = QCryptographicHash::hash(key.screenName.toUtf8(), QCryptographicHash::Md5).toHex().left(8);
+    return QStringLiteral("wallpaper_%1_%2x%3@%4_").arg(QString::fromLatin1(screenId))
+            .arg(key.screenSize.width()).arg(key.screenSize.height()).arg(qRound(key.devicePixelRatio * 100));
+}
+
+// Every entry has a name of its own, made from all of its key, so a new one never has to
+// replace a file which is still mapped (which Windows doesn't allow). The older entries of
+// the same screen configuration are removed once nobody maps them anymore.
+static inline QString cacheFilePath(const WallpaperCache::Key &key)
+{
+    const QString dir = cacheDirPath();
+    if (dir.isEmpty()) {
+        return {};
+    }
+    const WallpaperCacheHeader header = headerFor(key);
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(reinterpret_cast<const char *>(&header), sizeof(header));
+    hash.addData(reinterpret_cast<const char *>(key.path.utf16()), key.path.size() * int(sizeof(char16_t)));
+    const QString name = cacheFilePrefix(key) + QString::fromLatin1(hash.result().toHex().left(16)) + QStringLiteral(".bin");
+    return QDir(dir).filePath(name);
+}
+
+// Removing a file fails on Windows while it's mapped, by this process or by another one, it
+// is tried again the next time then.
+static inline void removeStaleEntries(const WallpaperCache::Key &key, const QString &current)
+{
+    QDir dir(cacheDirPath());
+    const QString currentName = QFileInfo(current).fileName();
+    const QStringList names = dir.entryList({cacheFilePrefix(key) + QStringLiteral("*.bin")}, QDir::Files);
+    for (auto &&name : qAsConst(names)) {
+        if (name != currentName) {
+            dir.remove(name);
+        }
+    }
+}
+
+static void closeMappedFile(void *info)
+{
+    // Closing the file unmaps it.
+    delete static_cast<QFile *>(info);
+}
+
+bool WallpaperCache::setFile(Key &key, const QString &path)
+{
+    const QFileInfo fileInfo(path);
+    if (path.isEmpty() || !fileInfo.isFile()) {
+        return false;
+    }
+    key.path = fileInfo.absoluteFilePath();
+    key.lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+    key.fileSize = fileInfo.size();
+    return true;
+}
+
+QImage WallpaperCache::load(const Key &key)
+{
+    if (key.path.isEmpty() || key.screenSize.isEmpty() || (key.path.size() > g_maxPathLength)) {
+        return {};
+    }
+    const QString filePath = cacheFilePath(key);
+    if (filePath.isEmpty()) {
+        return {};
+    }
+    auto file = new QFile(filePath);
+    if (!file->open(QFile::ReadOnly)) {
+        delete file;
+        return {};
+    }
+    const WallpaperCacheHeader expected = headerFor(key);
+    const qint64 pixelSize = qint64(expected.bytesPerLine) * expected.imageHeight;
+    WallpaperCacheHeader header = {};
+    QVector<char16_t> path(expected.pathLength);
+    const qint64 pathSize = qint64(path.size()) * qint64(sizeof(char16_t));
+    // A file of the wrong size would make reading the mapping fail at some point later on.
+    const bool valid = (file->size() == (g_headerSize + pixelSize))
+            && (file->read(reinterpret_cast<char *>(&header), sizeof(header)) == qint64(sizeof(header)))
+            && (std::memcmp(&header, &expected, sizeof(header)) == 0)
+            && (file->read(reinterpret_cast<char *>(path.data()), pathSize) == pathSize)
+            && (std::memcmp(path.constData(), key.path.utf16(), pathSize) == 0);
+    const uchar *pixels = valid ? file->map(g_headerSize, pixelSize) : nullptr;
+    if (!pixels) {
+        delete file;
+        return {};
+    }
+    QImage image(pixels, expected.imageWidth, expected.imageHeight, expected.bytesPerLine,
+                 QImage::Format_ARGB32_Premultiplied, closeMappedFile, file);
+    if (image.isNull()) {
+        delete file;
+        return {};
+    }
+    removeStaleEntries(key, filePath);
+    return image;
+}
+
+bool WallpaperCache::save(const Key &key, const QImage &image)
+{
+    if (key.path.isEmpty() || (key.path.size() > g_maxPathLength) || image.isNull()
+            || (image.size() != key.screenSize) || (image.format() != QImage::Format_ARGB32_Premultiplied)) {
+        return false;
+    }
+    const QString filePath = cacheFilePath(key);
+    if (filePath.isEmpty() || !QDir().mkpath(QFileInfo(filePath).absolutePath())) {
+        return false;
+    }
+    const WallpaperCacheHeader header = headerFor(key);
+    QByteArray headerData(int(g_headerSize), 0);
+    std::memcpy(headerData.data(), &header, sizeof(header));
+    std::memcpy(headerData.data() + sizeof(header), key.path.utf16(), key.path.size() * sizeof(char16_t));
+    // Written under a temporary name and renamed, nobody maps a half written entry.
+    QSaveFile file(filePath);
+    if (!file.open(QSaveFile::WriteOnly)) {
+        return false;
+    }
+    bool ok = (file.write(headerData) == g_headerSize);
+    for (int y = 0; ok && (y < image.height()); ++y) {
+        ok = (file.write(reinterpret_cast<const char *>(image.constScanLine(y)), header.bytesPerLine) == header.bytesPerLine);
+    }
+    if (!ok || !file.commit()) {
+        qWarning() << "Failed to write the wallpaper cache" << filePath;
+        return false;
+    }
+    removeStaleEntries(key, filePath);
+    return true;
+}
@@ -0,0 +1,67 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2021 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "framelesshelper_global.h"
+#include "utilities.h"
+#include <QtGui/qimage.h>
+
+/*
+ * The blurred desktop wallpaper of QtAcrylicEffectHelper, kept on disk from one start of
+ * the process to the next. The file is a page (4 KiB) of header followed by the raw
+ * premultiplied ARGB32 rows, so a later start maps it straight into a QImage instead of
+ * decoding, scaling and blurring the wallpaper again. Nothing is loaded unless every
+ * field of the key matches the header.
+ */
+
+namespace WallpaperCache {
+
+// Bump it whenever the way the blurred wallpaper is produced changes.
+constexpr quint32 algorithmVersion = 4;
+
+struct Key
+{
+    QString path = {}; // Of the wallpaper image.
+    qint64 lastModified = 0; // In ms since the epoch.
+    qint64 fileSize = 0;
+    Utilities::DesktopWallpaperAspectStyle aspectStyle = Utilities::DesktopWallpaperAspectStyle::Central;
+    QString screenName = {}; // Every screen has its own file.
+    QSize screenSize = {}; // The size of the image, in device pixels.
+    qreal devicePixelRatio = 1.0;
+    qreal radius = 0.0;
+    QRgb backgroundColor = 0; // Shows around the wallpaper for some of the aspect styles.
+    quint32 algorithm = algorithmVersion;
+};
+
+// Fills in the file related fields of the key, false if "path" doesn't exist.
+bool setFile(Key &key, const QString &path);
+
+// A null image if there's no valid entry for "key". The result is read only, writing to it
+// makes a copy, and it keeps the file mapped until the last copy of it is gone.
+QImage load(const Key &key);
+// Only ARGB32_Premultiplied images of the screen size of "key" are stored.
+bool save(const Key &key, const QImage &image);
+
+}
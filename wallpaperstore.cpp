@@ -0,0 +1,466 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2021 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "wallpaperstore.h"
+#include "wallpapercache.h"
+#include "blurengine.h"
+#include "utilities.h"
+#include <QtCore/qfutureinterface.h>
+#include <QtCore/qthreadpool.h>
+#include <QtCore/qrunnable.h>
+#include <QtCore/qthread.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qvector.h>
+#include <QtCore/qpointer.h>
+#include <QtCore/qfileinfo.h>
+#include <QtGui/qpainter.h>
+#include <QtGui/qimagereader.h>
+#include <QtGui/qguiapplication.h>
+#include <QtGui/qscreen.h>
+
+namespace {
+
+struct WallpaperStoreEntry
+{
+    WallpaperStore::Key key = {};
+    QFutureInterface<QImage> job = {}; // Holds the buffer once it's done.
+    bool started = false;
+    int users = 0;
+};
+
+// Only a handful of screens and windows, a list is all it takes. The wallpapers are
+// rendered on a pool of their own, like the jobs of Utilities::blurImageAsync().
+struct WallpaperStoreData
+{
+    QThreadPool pool;
+    QMutex mutex;
+    QVector<WallpaperStoreEntry> entries = {};
+
+    explicit WallpaperStoreData()
+    {
+        pool.setMaxThreadCount(qMax(QThread::idealThreadCount() / 2, 1));
+    }
+};
+
+}
+
+Q_GLOBAL_STATIC(WallpaperStoreData, wallpaperStoreData)
+
+static inline bool operator==(const WallpaperStore::Key &lhs, const WallpaperStore::Key &rhs)
+{
+    return (lhs.screenName == rhs.screenName) && (lhs.screenGeometry == rhs.screenGeometry)
+            && qFuzzyCompare(lhs.devicePixelRatio, rhs.devicePixelRatio) && (lhs.wallpaperPath == rhs.wallpaperPath)
+            && (lhs.aspectStyle == rhs.aspectStyle) && (lhs.backgroundColor == rhs.backgroundColor)
+            && qFuzzyCompare(lhs.radius, rhs.radius);
+}
+
+static inline int findEntry(const WallpaperStoreData *data, const WallpaperStore::Key &key)
+{
+    for (int i = 0; i < data->entries.size(); ++i) {
+        if (data->entries.at(i).key == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// BlurEngine blurs at the levels of its pyramid as long as the radius left for the next one
+// is at least this wide. Decoding and keeping the wallpaper smaller by a factor that keeps
+// the radius above it skips levels the engine would have made anyway, the blur itself is
+// the same.
+static constexpr qreal g_minimumDecodeRadius = 32;
+
+static inline QSize shrinkSize(const QSize &size, const int factor)
+{
+    return {qMax(size.width() / factor, 1), qMax(size.height() / factor, 1)};
+}
+
+// Rounded down like shrinkSize(), QPoint::operator/() rounds to the nearest.
+static inline QPoint shrinkPoint(const QPoint &point, const int factor)
+{
+    const auto floorDivide = [factor](const int value) -> int {
+        return (value >= 0) ? (value / factor) : -((factor - 1 - value) / factor);
+    };
+    return {floorDivide(point.x()), floorDivide(point.y())};
+}
+
+// The part of the wallpaper at "path" which shows on a screen of "size" device pixels,
+// decoded at 1/"factor" of the size it's drawn at, and where it goes on a buffer of the
+// screen at 1/"factor" too. Tiled wallpapers are decoded as a whole. The image handlers
+// which support it (JPEG does) scale while decoding, the others are scaled by QImageReader.
+static QImage readWallpaper(const QString &path, const Utilities::DesktopWallpaperAspectStyle aspectStyle,
+                            const QSize &size, const int factor, QPoint *position)
+{
+    Q_ASSERT(position);
+    if (!position) {
+        return {};
+    }
+    QImageReader reader(path);
+    QSize imageSize = reader.size();
+    QImage image = {};
+    // Without a header to tell, it's decoded as it is and scaled afterwards.
+    if (!imageSize.isValid()) {
+        image = reader.read();
+        if (image.isNull()) {
+            return {};
+        }
+        imageSize = image.size();
+    }
+    QSize drawnSize = imageSize;
+    if (aspectStyle == Utilities::DesktopWallpaperAspectStyle::IgnoreRatioFit) {
+        drawnSize.scale(size, Qt::IgnoreAspectRatio);
+    } else if (aspectStyle == Utilities::DesktopWallpaperAspectStyle::KeepRatioFit) {
+        drawnSize.scale(size, Qt::KeepAspectRatio);
+    } else if (aspectStyle == Utilities::DesktopWallpaperAspectStyle::KeepRatioByExpanding) {
+        drawnSize.scale(size, Qt::KeepAspectRatioByExpanding);
+    }
+    QRect visible = {QPoint{0, 0}, drawnSize};
+    QPoint origin = {};
+    if (aspectStyle != Utilities::DesktopWallpaperAspectStyle::Tiled) {
+        const QRect rect = Utilities::alignedRect(Qt::LeftToRight, Qt::AlignCenter, drawnSize, {{0, 0}, size});
+        visible = rect.intersected({{0, 0}, size}).translated(-rect.topLeft());
+        if (visible.isEmpty()) {
+            return {};
+        }
+        origin = rect.topLeft();
+    }
+    const QSize scaledSize = shrinkSize(drawnSize, factor);
+    // Every decoded pixel that covers some of the visible part, the last ones partly.
+    const QPoint scaledTopLeft = shrinkPoint(visible.topLeft(), factor);
+    const QPoint scaledEnd = shrinkPoint(visible.bottomRight() + QPoint{factor, factor}, factor);
+    const QRect scaledVisible = QRect{scaledTopLeft, scaledEnd - QPoint{1, 1}}.intersected({{0, 0}, scaledSize});
+    // Where the first decoded pixel starts on the screen, it may begin a little before it.
+    *position = shrinkPoint(origin + scaledVisible.topLeft() * factor, factor);
+    if (image.isNull()) {
+        if (scaledSize != imageSize) {
+            reader.setScaledSize(scaledSize);
+        }
+        if (scaledVisible.size() != scaledSize) {
+            reader.setScaledClipRect(scaledVisible);
+        }
+        return reader.read();
+    }
+    if (scaledSize != imageSize) {
+        image = image.scaled(scaledSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    return (scaledVisible.size() != scaledSize) ? image.copy(scaledVisible) : image;
+}
+
+static QImage renderWallpaper(const WallpaperStore::Key &key)
+{
+    // The image isn't tagged with its device pixel ratio, that would make a copy of a
+    // mapped one.
+    const QSize size = (QSizeF(key.screenGeometry.size()) * key.devicePixelRatio).toSize();
+    const int factor = WallpaperStore::scaleFactor(key);
+    // Rounded up, the last row and column cover what's left of the screen.
+    const QSize scaledSize = {(size.width() + factor - 1) / factor, (size.height() + factor - 1) / factor};
+    QImage result(scaledSize, QImage::Format_ARGB32_Premultiplied);
+    result.fill(Qt::transparent);
+    const Utilities::DesktopWallpaperAspectStyle aspectStyle = key.aspectStyle;
+    WallpaperCache::Key cacheKey = {};
+    const bool cacheable = WallpaperCache::setFile(cacheKey, key.wallpaperPath);
+    cacheKey.screenName = key.screenName;
+    cacheKey.aspectStyle = aspectStyle;
+    cacheKey.screenSize = scaledSize;
+    cacheKey.devicePixelRatio = key.devicePixelRatio;
+    cacheKey.radius = key.radius;
+    cacheKey.backgroundColor = key.backgroundColor;
+    if (cacheable) {
+        const QImage cached = WallpaperCache::load(cacheKey);
+        if (!cached.isNull()) {
+            return cached;
+        }
+    }
+    QPoint position = {};
+    const QImage image = cacheable ? readWallpaper(cacheKey.path, aspectStyle, size, factor, &position) : QImage();
+    // On some platforms we may not be able to get the desktop wallpaper, such as Linux and WebAssembly.
+    if (image.isNull()) {
+        return result;
+    }
+    QImage buffer(scaledSize, QImage::Format_ARGB32_Premultiplied);
+    buffer.fill(QColor::fromRgba(key.backgroundColor));
+    {
+        QPainter painterBuffer(&buffer);
+        if (aspectStyle == Utilities::DesktopWallpaperAspectStyle::Tiled) {
+            painterBuffer.fillRect(QRect{{0, 0}, buffer.size()}, image);
+        } else {
+            painterBuffer.drawImage(position, image);
+        }
+    }
+    {
+        QPainter painter(&result);
+#if 1
+        // Solid color and gradient wallpapers don't need to be blurred at all, two levels off is
+        // far below what the tint and the noise on top of them change anyway.
+        BlurEngine engine;
+        engine.setContentTolerance(2);
+        // The radius is in device independent pixels, like everything else.
+        engine.blur(nullptr, buffer, key.radius * key.devicePixelRatio / factor, false);
+        painter.drawImage(QPoint{0, 0}, engine.takeResult());
+#else
+        painter.drawImage(QPoint{0, 0}, buffer);
+#endif
+    }
+    // The next start of the application maps this instead of doing all of the above again.
+    if (cacheable) {
+        WallpaperCache::save(cacheKey, result);
+    }
+    return result;
+}
+
+namespace {
+
+class WallpaperTask : public QRunnable
+{
+public:
+    explicit WallpaperTask(const QFutureInterface<QImage> &job, const WallpaperStore::Key &key) : m_job(job), m_key(key) {}
+    ~WallpaperTask() override = default;
+
+    void run() override
+    {
+        // Everybody released it while it was waiting.
+        if (!m_job.isCanceled()) {
+            QThread::currentThread()->setPriority(QThread::LowPriority);
+            const QImage image = renderWallpaper(m_key);
+            if (!m_job.isCanceled()) {
+                m_job.reportResult(image);
+            }
+        }
+        m_job.reportFinished();
+    }
+
+private:
+    QFutureInterface<QImage> m_job = {};
+    WallpaperStore::Key m_key = {};
+};
+
+}
+
+int WallpaperStore::scaleFactor(const Key &key)
+{
+    const qreal radius = key.radius * key.devicePixelRatio;
+    int factor = 1;
+    while ((radius / (factor * 2)) >= g_minimumDecodeRadius) {
+        factor *= 2;
+    }
+    return factor;
+}
+
+WallpaperStore::Key WallpaperStore::keyFor(const QScreen *screen, const qreal radius)
+{
+    if (!screen) {
+        screen = QGuiApplication::primaryScreen();
+    }
+    Key key = {};
+    key.radius = radius;
+    if (!screen) {
+        return key;
+    }
+    key.screenName = screen->name();
+    key.screenGeometry = screen->geometry();
+    key.devicePixelRatio = screen->devicePixelRatio();
+    const int index = QGuiApplication::screens().indexOf(const_cast<QScreen *>(screen));
+    key.wallpaperPath = Utilities::getDesktopWallpaperFilePath(index);
+    key.aspectStyle = Utilities::getDesktopWallpaperAspectStyle(index);
+#ifdef Q_OS_WINDOWS
+    if ((key.aspectStyle == Utilities::DesktopWallpaperAspectStyle::Central) ||
+            (key.aspectStyle == Utilities::DesktopWallpaperAspectStyle::KeepRatioFit)) {
+        key.backgroundColor = Utilities::getDesktopBackgroundColor(index).rgba();
+    }
+#endif
+    return key;
+}
+
+QFuture<QImage> WallpaperStore::acquire(const Key &key)
+{
+    WallpaperStoreData *data = wallpaperStoreData();
+    QMutexLocker locker(&data->mutex);
+    int index = findEntry(data, key);
+    if (index < 0) {
+        WallpaperStoreEntry entry = {};
+        entry.key = key;
+        data->entries.append(entry);
+        index = data->entries.size() - 1;
+    }
+    WallpaperStoreEntry &entry = data->entries[index];
+    // Other users of the same key wait for the running job instead of rendering it once more.
+    if (!entry.started) {
+        entry.job = {};
+        entry.job.reportStarted();
+        entry.started = true;
+        data->pool.start(new WallpaperTask(entry.job, key));
+    }
+    ++entry.users;
+    const QFuture<QImage> future = entry.job.future();
+    locker.unlock();
+    if (WallpaperWatcher *watcher = WallpaperWatcher::instance()) {
+        watcher->updateFiles();
+    }
+    return future;
+}
+
+void WallpaperStore::release(const Key &key)
+{
+    // Helpers which outlive the store (static ones) have nothing left to release.
+    if (wallpaperStoreData.isDestroyed()) {
+        return;
+    }
+    WallpaperStoreData *data = wallpaperStoreData();
+    QMutexLocker locker(&data->mutex);
+    const int index = findEntry(data, key);
+    Q_ASSERT(index >= 0);
+    if (index < 0) {
+        return;
+    }
+    WallpaperStoreEntry &entry = data->entries[index];
+    if (--entry.users > 0) {
+        return;
+    }
+    entry.job.cancel();
+    data->entries.removeAt(index);
+    locker.unlock();
+    if (WallpaperWatcher *watcher = WallpaperWatcher::instance()) {
+        watcher->updateFiles();
+    }
+}
+
+void WallpaperStore::invalidate(const Key &key)
+{
+    WallpaperStoreData *data = wallpaperStoreData();
+    QMutexLocker locker(&data->mutex);
+    const int index = findEntry(data, key);
+    if (index >= 0) {
+        // The current job, finished or not, stays with the users who have it already.
+        data->entries[index].started = false;
+    }
+}
+
+WallpaperWatcher *WallpaperWatcher::instance()
+{
+    static QPointer<WallpaperWatcher> watcher = nullptr;
+    if (!watcher && qGuiApp) {
+        // Goes away together with the application.
+        watcher = new WallpaperWatcher(qGuiApp);
+    }
+    return watcher;
+}
+
+WallpaperWatcher::WallpaperWatcher(QObject *parent) : QObject(parent)
+{
+    connect(&m_fileWatcher, &QFileSystemWatcher::fileChanged, this, &WallpaperWatcher::handleFileChange);
+    const auto screens = QGuiApplication::screens();
+    for (auto &&screen : qAsConst(screens)) {
+        watchScreen(screen);
+    }
+    connect(qGuiApp, &QGuiApplication::screenAdded, this, &WallpaperWatcher::watchScreen);
+    connect(qGuiApp, &QGuiApplication::screenRemoved, this, [this](QScreen *screen){
+        Q_EMIT backdropChanged(screen->name());
+    });
+}
+
+WallpaperWatcher::~WallpaperWatcher() = default;
+
+void WallpaperWatcher::watchScreen(QScreen *screen)
+{
+    Q_ASSERT(screen);
+    if (!screen) {
+        return;
+    }
+    const QString screenName = screen->name();
+    const auto notify = [this, screenName](){
+        Q_EMIT backdropChanged(screenName);
+    };
+    connect(screen, &QScreen::geometryChanged, this, notify);
+    connect(screen, &QScreen::logicalDotsPerInchChanged, this, notify);
+    connect(screen, &QScreen::physicalDotsPerInchChanged, this, notify);
+}
+
+void WallpaperWatcher::refresh()
+{
+    QStringList screenNames = {};
+    {
+        WallpaperStoreData *data = wallpaperStoreData();
+        QMutexLocker locker(&data->mutex);
+        for (auto &&entry : data->entries) {
+            entry.started = false;
+            if (!screenNames.contains(entry.key.screenName)) {
+                screenNames.append(entry.key.screenName);
+            }
+        }
+    }
+    for (auto &&screenName : qAsConst(screenNames)) {
+        Q_EMIT backdropChanged(screenName);
+    }
+}
+
+void WallpaperWatcher::updateFiles()
+{
+    QStringList paths = {};
+    {
+        WallpaperStoreData *data = wallpaperStoreData();
+        QMutexLocker locker(&data->mutex);
+        for (auto &&entry : qAsConst(data->entries)) {
+            const QString &path = entry.key.wallpaperPath;
+            if (!path.isEmpty() && !paths.contains(path)) {
+                paths.append(path);
+            }
+        }
+    }
+    const QStringList watched = m_fileWatcher.files();
+    for (auto &&path : qAsConst(watched)) {
+        if (!paths.contains(path)) {
+            m_fileWatcher.removePath(path);
+        }
+    }
+    for (auto &&path : qAsConst(paths)) {
+        if (!watched.contains(path) && QFileInfo::exists(path)) {
+            m_fileWatcher.addPath(path);
+        }
+    }
+}
+
+void WallpaperWatcher::handleFileChange(const QString &path)
+{
+    // Tools which replace the file instead of writing to it make the watcher drop it.
+    if (QFileInfo::exists(path) && !m_fileWatcher.files().contains(path)) {
+        m_fileWatcher.addPath(path);
+    }
+    QStringList screenNames = {};
+    {
+        WallpaperStoreData *data = wallpaperStoreData();
+        QMutexLocker locker(&data->mutex);
+        for (auto &&entry : data->entries) {
+            if (entry.key.wallpaperPath != path) {
+                continue;
+            }
+            entry.started = false;
+            if (!screenNames.contains(entry.key.screenName)) {
+                screenNames.append(entry.key.screenName);
+            }
+        }
+    }
+    for (auto &&screenName : qAsConst(screenNames)) {
+        Q_EMIT backdropChanged(screenName);
+    }
+}
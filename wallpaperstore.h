@@ -0,0 +1,112 @@
+/*
+ * MIT License
+ *
+ * Copyright (C) 2021 by wangwenx190 (Yuhang Zhao)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "framelesshelper_global.h"
+#include "utilities.h"
+#include <QtCore/qrect.h>
+#include <QtGui/qimage.h>
+#include <QtCore/qfuture.h>
+#include <QtCore/qfilesystemwatcher.h>
+
+QT_BEGIN_NAMESPACE
+QT_FORWARD_DECLARE_CLASS(QScreen)
+QT_END_NAMESPACE
+
+/*
+ * The blurred desktop wallpapers of all the QtAcrylicEffectHelper instances of the process.
+ * Helpers with the same key share one implicitly shared buffer, which is rendered (or
+ * loaded from the WallpaperCache) on a background thread for the first of them and freed
+ * when the last one releases it. Only use it from the GUI thread.
+ */
+
+namespace WallpaperStore {
+
+// The screen is "screenGeometry" times "devicePixelRatio" device pixels large.
+struct Key
+{
+    QString screenName = {};
+    QRect screenGeometry = {};
+    qreal devicePixelRatio = 1.0;
+    QString wallpaperPath = {}; // Of that screen, see Utilities::getDesktopWallpaperFilePath().
+    Utilities::DesktopWallpaperAspectStyle aspectStyle = Utilities::DesktopWallpaperAspectStyle::Central;
+    QRgb backgroundColor = 0; // Around the wallpaper, for the aspect styles which leave some room.
+    qreal radius = 0.0;
+};
+
+// The blurred wallpaper has no detail left that needs the full resolution, it's kept at
+// 1/scaleFactor() of the size of the screen in device pixels (rounded up), which depends
+// on the radius: 4 for 128 on a screen with a device pixel ratio of one.
+int scaleFactor(const Key &key);
+
+// The key of the wallpaper behind "screen", the primary screen if it's null. Everything the
+// system has to be asked for is found out here, on the GUI thread.
+Key keyFor(const QScreen *screen, const qreal radius);
+
+// The blurred wallpaper of "key", with one more user counted. Rendering it starts right
+// away if nobody else did yet, the future is finished already if the buffer is ready.
+QFuture<QImage> acquire(const Key &key);
+// One user less, every acquire() has to be paired with one release().
+void release(const Key &key);
+// Makes the next acquire() of "key" render the wallpaper again, the users of the old
+// buffer keep it until they release it.
+void invalidate(const Key &key);
+
+}
+
+/*
+ * Tells the users of the WallpaperStore when the backdrop of a screen has to be made
+ * again: the wallpaper file of one of its entries changed (those entries are invalidated
+ * already), or the screen changed its geometry, its DPI or went away. The keys of the
+ * other screens stay valid.
+ */
+class WallpaperWatcher : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY_MOVE(WallpaperWatcher)
+
+public:
+    // Null once the application is gone.
+    static WallpaperWatcher *instance();
+
+    // Invalidates every entry of the store and reports all of their screens, for a change
+    // of the wallpaper that the file system doesn't see, such as a different file.
+    void refresh();
+    // Follows the wallpaper files of the current entries of the store.
+    void updateFiles();
+
+Q_SIGNALS:
+    void backdropChanged(const QString &screenName);
+
+private:
+    explicit WallpaperWatcher(QObject *parent = nullptr);
+    ~WallpaperWatcher() override;
+
+    void watchScreen(QScreen *screen);
+    void handleFileChange(const QString &path);
+
+private:
+    QFileSystemWatcher m_fileWatcher;
+};